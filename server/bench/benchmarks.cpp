@@ -0,0 +1,252 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include "CString.h"
+#include "IEnums.h"
+#include "main.h"
+#include "TServer.h"
+#include "TPlayer.h"
+#include "TLevel.h"
+
+// Benchmarks for hot paths that were changed for speed.  They are linked
+// against the server sources and drive the real code, on servers that are
+// constructed but never started.  Build with -DBENCHMARKS=ON and run
+// ./benchmarks.  Everything they write goes in a temporary directory.
+
+typedef std::chrono::steady_clock benchClock;
+
+// main.cpp isn't linked in, so provide what the server takes from it.
+static CString homepath;
+std::atomic_bool shutdownProgram{ false };
+
+const CString getHomePath()
+{
+	return homepath;
+}
+
+static double elapsedMs(const benchClock::time_point& pStart)
+{
+	return std::chrono::duration<double, std::milli>(benchClock::now() - pStart).count();
+}
+
+/*
+	Receive path (TPlayer::doMain)
+*/
+static CString makeBurst(int pBytes, const CString& pPacket)
+{
+	// Framed like the client sends them: a two byte length, then the packet.
+	CString burst;
+	char header[2] = { (char)((pPacket.length() >> 8) & 0xFF), (char)(pPacket.length() & 0xFF) };
+	while (burst.length() + 2 + pPacket.length() <= pBytes)
+	{
+		burst.write(header, 2);
+		burst.write(pPacket.text(), pPacket.length());
+	}
+	return burst;
+}
+
+static void benchReceiveBurst()
+{
+	// 10 bytes on the wire: the length, then PLI_LANGUAGE "German".
+	CString packet = CString() >> (char)PLI_LANGUAGE << "German\n";
+	CString burst = makeBurst(64 * 1024, packet);
+	int packets = burst.length() / (packet.length() + 2);
+	const int bursts = 200;
+
+	printf("Receive, %d bursts of %d bytes (%d packets of %d bytes each)\n", bursts, burst.length(), packets, packet.length() + 2);
+	printf("%16s %16s %16s\n", "read size", "ms per burst", "ns per packet");
+
+	// A whole burst in one read, then the way TCP usually hands it over.
+	const int readSizes[] = { burst.length(), 1460 };
+	for (int readSize : readSizes)
+	{
+		TServer* server = new TServer("bench");
+		TPlayer* player = new TPlayer(server, nullptr, 2);
+		player->setType(PLTYPE_CLIENT);
+		server->getPlayerList()->push_back(player);
+
+		bool ok = true;
+		auto start = benchClock::now();
+		for (int i = 0; i < bursts && ok; ++i)
+		{
+			for (int pos = 0; pos < burst.length() && ok; pos += readSize)
+			{
+				int size = (burst.length() - pos < readSize ? burst.length() - pos : readSize);
+				ok = player->receiveData(burst.text() + pos, size);
+			}
+		}
+		double total = elapsedMs(start);
+
+		if (!ok || player->getLanguage() != "German")
+			printf("  the packets weren't parsed\n");
+		printf("%16d %16.3f %16.1f\n", readSize, total / bursts, total * 1000000.0 / ((double)bursts * packets));
+
+		delete server;
+	}
+	printf("\n");
+}
+
+/*
+	Levels
+*/
+static CString benchLevelName(int pIndex)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "bench_%04d.nw", pIndex);
+	return CString(name);
+}
+
+static std::string benchWorldDir()
+{
+	return std::string(homepath.text()) + "servers/bench/world";
+}
+
+// Writes levels like the ones in a world: full boards, a link to the next
+// level and a sign.
+static void writeLevels(int pCount)
+{
+	static const char* tileChars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+	std::string dir = benchWorldDir();
+	std::filesystem::create_directories(dir);
+	for (int i = 0; i < pCount; ++i)
+	{
+		CString level("GLEVNW01\n");
+		for (int y = 0; y < 64; ++y)
+		{
+			level << "BOARD 0 " << CString(y) << " 64 0 ";
+			for (int x = 0; x < 64; ++x)
+			{
+				int tile = (x * 7 + y * 13 + i) % 4096;
+				char chars[2] = { tileChars[tile >> 6], tileChars[tile & 63] };
+				level.write(chars, 2);
+			}
+			level << "\n";
+		}
+		level << "LINK " << benchLevelName((i + 1) % pCount) << " 0 0 1 64 62 playery\n";
+		level << "SIGN 10 10\nWelcome to level " << CString(i) << ".\nSIGNEND\n";
+		level.save(CString() << dir.c_str() << "/" << benchLevelName(i));
+	}
+}
+
+// A server that finds the levels from writeLevels(), without starting it.
+static TServer* newLevelServer(bool pLevelCache)
+{
+	TServer* server = new TServer("bench");
+	server->getSettings()->addKey("nofoldersconfig", "true");
+	server->getSettings()->addKey("levelcache", (pLevelCache ? "true" : "false"));
+	server->getFileSystem()->addDir("world");
+	return server;
+}
+
+/*
+	Level broadcast (TServer::sendPacketToLevel)
+*/
+static void benchLevelBroadcast()
+{
+	const int levelPlayers = 8;
+	const int broadcasts = 20000;
+	CString packet = CString() >> (char)PLO_ITEMADD >> (char)20 >> (char)20 >> (char)0;
+
+	printf("Level broadcast, %d players on the level, %d broadcasts\n", levelPlayers, broadcasts);
+	printf("%10s %16s %16s\n", "online", "total ms", "us per packet");
+
+	writeLevels(2);
+
+	// Every player keeps a table of 16000 external players, so a few thousand
+	// online is as far as this goes without running out of memory.
+	const int counts[] = { 100, 500, 2000 };
+	for (int count : counts)
+	{
+		TServer* server = newLevelServer(false);
+		TLevel* target = TLevel::findLevel(benchLevelName(0), server);
+		TLevel* elsewhere = TLevel::findLevel(benchLevelName(1), server);
+		if (target == nullptr || elsewhere == nullptr)
+		{
+			printf("  could not load the levels\n");
+			delete server;
+			break;
+		}
+
+		// Everybody else is on some other level.
+		int step = count / levelPlayers;
+		for (int i = 0; i < count; ++i)
+		{
+			TPlayer* player = new TPlayer(server, nullptr, i + 2);
+			player->setType(PLTYPE_CLIENT);
+			server->getPlayerList()->push_back(player);
+			if (i % step == 0 && i / step < levelPlayers)
+				target->addPlayer(player);
+			else elsewhere->addPlayer(player);
+		}
+
+		auto start = benchClock::now();
+		for (int i = 0; i < broadcasts; ++i)
+			server->sendPacketToLevel(packet, nullptr, target);
+		double total = elapsedMs(start);
+
+		printf("%10d %16.3f %16.3f\n", count, total, total * 1000.0 / broadcasts);
+		delete server;
+	}
+	printf("\n");
+}
+
+/*
+	Level loading (TLevel::findLevel, CLevelCache)
+*/
+static void benchLevelLoad()
+{
+	const int levels = 5000;
+
+	printf("Level load, %d levels on a fresh server\n", levels);
+	printf("%24s %16s %16s\n", "", "total ms", "us per level");
+
+	// The files were just written, so this is the parsing and not the disk.
+	writeLevels(levels);
+	std::filesystem::remove_all(std::string(homepath.text()) + "servers/bench/levelcache");
+
+	// Without the cache, then filling it, then reading it back.
+	const char* names[] = { "levelcache off", "levelcache empty", "levelcache full" };
+	const bool useCache[] = { false, true, true };
+	for (int run = 0; run < 3; ++run)
+	{
+		TServer* server = newLevelServer(useCache[run]);
+
+		int loaded = 0;
+		auto start = benchClock::now();
+		for (int i = 0; i < levels; ++i)
+		{
+			if (TLevel::findLevel(benchLevelName(i), server) != nullptr)
+				++loaded;
+		}
+		double total = elapsedMs(start);
+
+		if (loaded != levels)
+			printf("  only loaded %d levels\n", loaded);
+		printf("%24s %16.3f %16.3f\n", names[run], total, total * 1000.0 / levels);
+		delete server;
+	}
+	printf("\n");
+}
+
+int main()
+{
+	std::string dir = (std::filesystem::temp_directory_path() / "gs2emu-bench-XXXXXX").string();
+	if (mkdtemp(&dir[0]) == nullptr)
+	{
+		printf("Could not create a temporary directory.\n");
+		return 1;
+	}
+	homepath = CString() << dir.c_str() << "/";
+	std::filesystem::create_directories(std::string(homepath.text()) + "servers/bench/logs");
+
+	benchReceiveBurst();
+	benchLevelBroadcast();
+	benchLevelLoad();
+
+	std::filesystem::remove_all(dir);
+	return 0;
+}
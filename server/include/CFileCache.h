@@ -0,0 +1,92 @@
+#ifndef CFILECACHE_H
+#define CFILECACHE_H
+
+#include <time.h>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "CString.h"
+
+// Default budget of the cache and the largest file we will keep in it.
+#define FILECACHE_DEFAULTSIZE	(64 * 1024 * 1024)
+#define FILECACHE_MAXENTRY		(4 * 1024 * 1024)
+
+// Downloads are sent as PLO_FILE packets of this many bytes of the file.
+#define FILECACHE_CHUNKSIZE		32000
+
+// One PLO_FILE chunk of a cached file, framed the way it goes out.
+struct SCachedChunk
+{
+	CString header;			// PLO_RAWDATA announcing the packet
+	CString packet;			// PLO_FILE with the chunk
+	CString zlib, bz2;		// header and packet compressed, empty until asked for
+};
+
+// A file as it was on disk when it was cached.  The data is never modified
+// once cached, so it can be handed out to any number of downloads.
+struct SCachedFile
+{
+	CString data;
+	std::string path;
+	time_t modTime;
+	long long size;
+
+	// Chunks are framed the first time someone downloads them under chunkName.
+	// Guarded by chunkLock, chunkBytes by the cache lock.
+	mutable std::mutex chunkLock;
+	mutable CString chunkName;
+	mutable std::vector<std::shared_ptr<const SCachedChunk> > chunks;
+	mutable size_t chunkBytes;
+};
+
+struct SFileCacheStats
+{
+	unsigned long long hits, misses, evictions;
+	size_t bytes, byteLimit, files;
+};
+
+// Byte-budgeted LRU cache of file contents, keyed by full path.
+// There is a single cache shared by every server in the process.
+class CFileCache
+{
+	public:
+		static CFileCache& shared();
+
+		//! Returns the contents of a file, loading it if it isn't cached or has changed on disk.
+		//! \param pPath The full path of the file.
+		//! \param pModTime The modification time the file has now.
+		//! \param pSize The size the file has now.
+		//! \return The cached file, or nullptr if the file is too large to cache or could not be read.
+		std::shared_ptr<const SCachedFile> get(const CString& pPath, time_t pModTime, long long pSize);
+
+		//! Returns a chunk of a cached file as PLO_RAWDATA and PLO_FILE packets.
+		//! \param pFile A file returned by get().
+		//! \param pIndex Which FILECACHE_CHUNKSIZE chunk of the file.
+		//! \param pName The file name the client asked for.
+		//! \param pCompress Also fill in the zlib and bz2 variants.
+		//! \return The chunk, or nullptr if the file is being sent under another name.
+		std::shared_ptr<const SCachedChunk> getChunk(const std::shared_ptr<const SCachedFile>& pFile, size_t pIndex, const CString& pName, bool pCompress = false);
+
+		void setByteLimit(size_t pBytes);
+		void clear();
+		SFileCacheStats getStats();
+
+	private:
+		CFileCache();
+		void evict();
+		void addChunkBytes(const SCachedFile* pFile, size_t pBytes);
+		static size_t entryBytes(const SCachedFile* pFile)	{ return (size_t)pFile->size + pFile->chunkBytes; }
+
+		typedef std::list<std::pair<std::string, std::shared_ptr<const SCachedFile> > > LRUList;
+
+		std::mutex m_lock;
+		LRUList lruList;										// front is the most recently used
+		std::unordered_map<std::string, LRUList::iterator> fileIndex;
+		size_t bytes, byteLimit;
+		unsigned long long hits, misses, evictions;
+};
+
+#endif
@@ -2,9 +2,16 @@
 #define CFILESYSTEM_H
 
 #include <map>
+#include <memory>
 #include <mutex>
+#include <string>
+#include <unordered_map>
 #include "CString.h"
 
+// The file list is split into this many parts by file name, so a change only
+// has to copy the part the file is in.
+#define FILESYSTEM_SHARDS	64
+
 class TServer;
 class CFileSystem
 {
@@ -17,9 +24,14 @@ class CFileSystem
 #endif
 
 	public:
+		typedef std::map<CString, CString> FileList;
+
 		CFileSystem();
 		CFileSystem(TServer* pServer);
 		~CFileSystem();
+
+		//! Removes all directories and files.  Call it between beginUpdate() and
+		//! endUpdate() to replace the contents without publishing an empty list.
 		void clear();
 
 		void setServer(TServer* pServer) { server = pServer; }
@@ -30,6 +42,16 @@ class CFileSystem
 		void removeFile(const CString& file);
 		void resync();
 
+		//! Groups changes so readers see them all at once.  Every change is
+		//! wrapped in these, and only the outermost endUpdate() publishes.
+		void beginUpdate();
+		void endUpdate();
+
+		// Changes reported by CFileWatcher.  pDirectory is the full path of one
+		// of our directories, with the trailing separator.
+		void fileAdded(const CString& pDirectory, const CString& pName);
+		void fileRemoved(const CString& pDirectory, const CString& pName);
+
 		CString find(const CString& file) const;
 		CString findi(const CString& file) const;
 		CString fileExistsAs(const CString& file) const;
@@ -37,9 +59,10 @@ class CFileSystem
 		time_t getModTime(const CString& file) const;
 		bool setModTime(const CString& file, time_t modTime) const;
 		int getFileSize(const CString& file) const;
-		std::map<CString, CString>& getFileList()	{ return fileList; }
+		std::shared_ptr<const FileList> getFileList() const;
 		std::vector<CString>* getDirList()			{ return &dirList; }
 
+		// Only held while changing the file system.  Lookups don't need it.
 		mutable std::recursive_mutex* m_preventChange;
 
 		static constexpr char getPathSeparator();
@@ -47,10 +70,54 @@ class CFileSystem
 
 	private:
 		void loadAllDirectories(const CString& directory, bool recursive = false);
+		void setFile(const CString& name, const CString& path);
+		void unsetFile(const CString& name);
+		int getDirOrder(const CString& pDirectory, const CString& pName) const;
+
+		// Entry in the case insensitive index.  When several files only differ
+		// in case, name is the one that sorts first, same as a scan would find.
+		struct SFileIndex
+		{
+			CString name;
+			unsigned int count;
+		};
+
+		// The file list is never changed once it is published.  Readers take a
+		// reference to the current one, changes are made to a copy which then
+		// replaces it.  Files are put in shards by their lowercase name, so the
+		// ones that only differ in case end up together, and a change only has
+		// to copy the shards it touches.
+		struct SShard
+		{
+			FileList fileList;
+			std::unordered_map<std::string, SFileIndex> fileIndex;	// lowercase file name -> file
+		};
+		struct SSnapshot
+		{
+			SSnapshot();
+			std::shared_ptr<const SShard> shards[FILESYSTEM_SHARDS];
+
+			// All the shards in one list, made when somebody first asks for it.
+			mutable std::mutex fileListLock;
+			mutable std::shared_ptr<const FileList> fileList;
+		};
+		std::shared_ptr<const SSnapshot> getSnapshot() const	{ return std::atomic_load(&snapshot); }
+		static const std::shared_ptr<const SShard>& getEmptyShard();
+		static unsigned int getShard(const std::string& lowerName);
+
+		// Caller must be inside beginUpdate()/endUpdate().
+		const SShard& getPendingShard(unsigned int shard) const;
+		SShard& changePendingShard(unsigned int shard);
+		CString getPendingPath(const CString& name) const;
+		void clearPending();
 
 		TServer* server;
 		CString basedir;
-		std::map<CString, CString> fileList;
+		std::shared_ptr<const SSnapshot> snapshot;
+		std::shared_ptr<const SShard> pendingBase[FILESYSTEM_SHARDS];	// what the update started from
+		std::shared_ptr<SShard> pendingCopy[FILESYSTEM_SHARDS];			// shards changed so far
+		bool pendingChanged;
+		int updateDepth;
 		std::vector<CString> dirList;
 };
 
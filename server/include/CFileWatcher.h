@@ -0,0 +1,58 @@
+#ifndef CFILEWATCHER_H
+#define CFILEWATCHER_H
+
+#include <set>
+#include <unordered_map>
+#include <vector>
+#include "CString.h"
+#include "CSocket.h"
+
+class CFileSystem;
+
+// Keeps file systems up to date as files are added, removed and renamed, so
+// they don't need a full resync every few minutes.
+// On Linux this is an inotify descriptor registered with the server's socket
+// reactor, so changes are applied on the server thread as they come in.  If
+// the kernel queue overflows, the affected file systems are resynced.
+// Elsewhere open() fails and the server keeps resyncing on a timer.
+class CFileWatcher : public CSocketStub
+{
+	public:
+		// Required by CSocketStub.
+		bool onRecv();
+		bool onSend()				{ return true; }
+		bool onRegister()			{ return true; }
+		void onUnregister()			{ return; }
+		SOCKET getSocketHandle()	{ return (SOCKET)inotifyFd; }
+		bool canRecv()				{ return true; }
+		bool canSend()				{ return false; }
+
+		CFileWatcher();
+		~CFileWatcher();
+
+		bool open();
+		void close();
+		bool isActive() const		{ return inotifyFd != -1; }
+
+		//! Watches every directory of a file system.  Can be called again after
+		//! the file system has changed to pick up new directories.
+		void watch(CFileSystem* pFileSystem);
+
+		//! Stops watching everything.
+		void clear();
+
+	private:
+		void resync(const std::set<CFileSystem*>& pFileSystems);
+
+		struct SWatch
+		{
+			CFileSystem* fileSystem;
+			CString directory;
+		};
+
+		int inotifyFd;
+		std::unordered_map<int, std::vector<SWatch> > watches;	// watch descriptor -> directories
+		std::set<CFileSystem*> fileSystems;
+};
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef CLEVELCACHE_H
+#define CLEVELCACHE_H
+
+#include <vector>
+#include "CString.h"
+#include "TLevelChest.h"
+
+// Bump when the layout of a compiled level changes.  Old files are then
+// ignored and rewritten.
+#define LEVELCACHE_VERSION		1
+
+// A level as read from its file, before it is turned into a TLevel.
+// Links are kept even if their level doesn't exist, as that is checked
+// every time the level is loaded.
+struct SLevelData
+{
+	SLevelData() : tiles() { }
+
+	struct SBaddy
+	{
+		float x, y;
+		char type;
+		CString props;
+	};
+
+	struct SNPC
+	{
+		CString image, code;
+		float x, y;
+	};
+
+	struct SSign
+	{
+		int x, y;
+		CString text;
+		bool encoded;
+	};
+
+	CString fileVersion;
+	short tiles[4096];
+	std::vector<std::vector<CString> > links;
+	std::vector<SBaddy> baddies;
+	std::vector<SNPC> npcs;
+	std::vector<TLevelChest> chests;
+	std::vector<SSign> signs;
+};
+
+// Compiled copies of parsed levels, so they don't need to be parsed again.
+// A compiled level remembers the path, size and modification time of the
+// file it was made from, and is ignored once any of those change.  It is
+// read straight out of a memory mapping of the file.
+class CLevelCache
+{
+	public:
+		//! Loads a compiled level.
+		//! \param pCacheFile The compiled level.
+		//! \param pSourceFile The level file it must have been compiled from.
+		//! \param pData Receives the level.
+		//! \return False if there is no up to date compiled level.
+		static bool load(const CString& pCacheFile, const CString& pSourceFile, SLevelData& pData);
+
+		//! Writes a compiled level.  Creates the directory if needed.
+		//! \param pCacheFile Where to write the compiled level.
+		//! \param pSourceFile The level file it was compiled from.
+		//! \param pData The level.
+		//! \return True if it was written.
+		static bool save(const CString& pCacheFile, const CString& pSourceFile, const SLevelData& pData);
+};
+
+#endif
@@ -36,6 +36,7 @@ public:
 	bool Initialize();
 	void Cleanup(bool shutDown = false);
 	void RunScripts(const std::chrono::high_resolution_clock::time_point& time);
+	bool hasPendingEvents() const;
 
 	void ScriptWatcher();
 	void StartScriptExecution(const std::chrono::high_resolution_clock::time_point& startTime);
@@ -123,6 +124,11 @@ inline bool CScriptEngine::StopScriptExecution()
 	return res;
 }
 
+inline bool CScriptEngine::hasPendingEvents() const
+{
+	return (!_updateNpcs.empty() || !_updateWeapons.empty());
+}
+
 // Getters
 
 inline TServer * CScriptEngine::getServer() const {
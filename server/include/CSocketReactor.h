@@ -0,0 +1,82 @@
+#ifndef CSOCKETREACTOR_H
+#define CSOCKETREACTOR_H
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include "CSocket.h"
+
+// Drop-in replacement for CSocketManager used by TServer.
+// On Linux the registered sockets live in an epoll set and the server thread
+// sleeps until a socket is ready or the tick timer (timerfd) fires, instead of
+// polling every socket with select() every 5ms.  Other platforms fall back to
+// CSocketManager.
+class CSocketReactor
+{
+	public:
+		CSocketReactor();
+		~CSocketReactor();
+
+		bool registerSocket(CSocketStub* stub);
+		bool unregisterSocket(CSocketStub* stub);
+		bool updateSingle(CSocketStub* stub, bool pRecv = true, bool pSend = true);
+		void cleanup(bool callOnUnregister = true);
+
+		// Wait for socket events or the next tick.  A timeout of -1 waits until
+		// something happens, 0 only collects events that are already pending.
+		bool update(int timeoutMs = -1);
+
+		// How often update() returns on an idle server.
+		void setTickInterval(const std::chrono::milliseconds& interval);
+
+		// Makes a waiting update() return early.  Safe to call from any thread.
+		void wakeup();
+
+		// Has the socket flushed before the next wait.  Owners call this when
+		// they queue something to send.  Safe to call from any thread.
+		void markDirty(CSocketStub* stub);
+
+	private:
+#ifdef __linux__
+		bool open();
+		void close();
+		void dispatch(CSocketStub* stub, unsigned int events);
+		void updateInterest(CSocketStub* stub, bool wantWrite);
+		void flushPending();
+		void removeStub(CSocketStub* stub, bool callOnUnregister);
+
+		struct SStubEntry
+		{
+			SOCKET handle;
+			bool isListener;
+			bool writeArmed;
+		};
+
+		int epollFd;
+		int timerFd;
+		int wakeFd;
+		std::unordered_map<CSocketStub*, SStubEntry> stubs;
+		std::mutex dirtyLock;
+		std::unordered_set<CSocketStub*> dirty;		// sockets with something to send
+#else
+		CSocketManager sockManager;
+#endif
+		std::chrono::milliseconds tickInterval;
+};
+
+// While one of these is alive, every send() made on this thread is added to
+// the counter.  gs2lib does the sending, so the calls are only seen when the
+// server is linked with -Wl,--wrap=send (WRAP_SEND), otherwise nothing is counted.
+class CSendCounter
+{
+	public:
+		CSendCounter(std::atomic<unsigned long long>* pCounter);
+		~CSendCounter();
+
+	private:
+		std::atomic<unsigned long long>* previous;
+};
+
+#endif
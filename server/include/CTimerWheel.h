@@ -0,0 +1,80 @@
+#ifndef CTIMERWHEEL_H
+#define CTIMERWHEEL_H
+
+#include <chrono>
+#include <vector>
+
+class TLevel;
+
+// Wheel sizes.  The inner wheel has one slot per second, the outer wheel one
+// slot per TIMERWHEEL_INNER seconds.  Anything further out waits in an overflow list.
+#define TIMERWHEEL_INNER	256
+#define TIMERWHEEL_OUTER	64
+
+// Seconds on a monotonic clock.  Used for all level deadlines so changing the
+// system clock doesn't expire everything at once.
+inline long long getTimerSeconds()
+{
+	return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Deadline for level objects that expire or respawn (board changes, items, horses, baddies).
+class CDeadline
+{
+	public:
+		CDeadline() : due(-1) { }
+
+		// Expire in pSeconds.  A negative value means never.
+		void setTimeout(int pSeconds)		{ due = (pSeconds < 0 ? -1 : getTimerSeconds() + pSeconds); }
+		void clear()						{ due = -1; }
+
+		bool isSet() const					{ return due >= 0; }
+		long long getDue() const			{ return due; }
+
+		// Returns true, once, when the deadline has passed.
+		bool expire(long long pNow)
+		{
+			if (due < 0 || pNow < due)
+				return false;
+			due = -1;
+			return true;
+		}
+
+	private:
+		long long due;
+};
+
+// Hierarchical timing wheel of levels with pending timed events.
+// Each level registers the time of its next event and only the levels that
+// are due get returned by advance(), instead of sweeping every loaded level.
+class CTimerWheel
+{
+	public:
+		CTimerWheel();
+
+		void add(TLevel* pLevel, long long pDue);
+		void remove(TLevel* pLevel, long long pDue);
+		void clear();
+
+		// Moves the wheel to pNow and collects every level that has become due.
+		void advance(long long pNow, std::vector<TLevel*>& pExpired);
+
+	private:
+		struct STimer
+		{
+			TLevel* level;
+			long long due;
+		};
+
+		void insert(const STimer& pTimer);
+		void cascade();
+		static bool removeFrom(std::vector<STimer>& pList, TLevel* pLevel, long long pDue);
+
+		std::vector<STimer> inner[TIMERWHEEL_INNER];
+		std::vector<STimer> outer[TIMERWHEEL_OUTER];
+		std::vector<STimer> overflow;
+		std::vector<STimer> ready;
+		long long current;
+};
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef CWORKERPOOL_H
+#define CWORKERPOOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Fixed pool of worker threads.
+// Jobs are queued under a key (usually the connection they belong to).  Jobs
+// with the same key run one at a time and in the order they were queued, so
+// per-connection state like the encryption key stream stays consistent.
+class CWorkerPool
+{
+	public:
+		CWorkerPool();
+		~CWorkerPool();
+
+		void start(unsigned int pThreads);
+		void stop();
+		bool isRunning() const			{ return !threads.empty(); }
+
+		//! Queues a job to run on a worker thread.
+		//! \param pKey Jobs with the same key never run at the same time.
+		//! \param pJob The job to run.
+		void queue(const void* pKey, std::function<void()> pJob);
+
+		//! Drops any queued jobs for a key and waits for a running one to finish.
+		//! Must be called before whatever the jobs use is deleted.
+		//! \param pKey The key the jobs were queued with.
+		void cancel(const void* pKey);
+
+		//! Waits until every job queued under a key has finished.
+		//! \param pKey The key the jobs were queued with.
+		void wait(const void* pKey);
+
+		//! Runs a batch of independent jobs in parallel and waits for all of
+		//! them.  If the pool isn't running they are run here, one by one.
+		//! \param pJobs The jobs to run.
+		void runAll(std::vector<std::function<void()> >& pJobs);
+
+	private:
+		void run();
+
+		struct SStrand
+		{
+			SStrand() : active(false) { }
+
+			std::deque<std::function<void()> > jobs;
+			bool active;
+		};
+
+		std::mutex m_lock;
+		std::condition_variable m_jobReady, m_jobDone;
+		std::unordered_map<const void*, SStrand> strands;
+		std::deque<const void*> readyKeys;
+		std::vector<std::thread> threads;
+		bool stopping;
+};
+
+#endif
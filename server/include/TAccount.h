@@ -138,6 +138,17 @@ class TAccount
 		bool loadAccount(const CString& pAccount, bool ignoreNickname = false);
 		bool saveAccount();
 
+		//! Reads an account file, falling back to the default account.
+		//! Only touches the file system, so it is safe to call from a worker thread.
+		//! \param pServer The server the account belongs to.
+		//! \param pAccount The account name.
+		//! \param pFileData Receives the lines of the file.
+		//! \param pLoadedFromDefault Set if the account doesn't exist yet.
+		static void readAccountFile(TServer* pServer, const CString& pAccount, std::vector<CString>& pFileData, bool& pLoadedFromDefault);
+
+		//! Loads the account from lines read by readAccountFile().
+		bool parseAccount(const CString& pAccount, std::vector<CString>& pFileData, bool pLoadedFromDefault, bool ignoreNickname = false);
+
 		// Attribute-Managing
 		bool hasChest(const CString& pChest);
 		bool hasWeapon(const CString& pWeapon);
@@ -192,6 +203,7 @@ class TAccount
 		const CString& getEmail() const			{ return email; }
 		const CString& getIpStr() const			{ return accountIpStr; }
 		const CString& getComments() const		{ return accountComments; }
+		const CString& getLanguage() const		{ return language; }
 		std::unordered_map<std::string, CString> * getFlagList()	{ return &flagList; }
 		std::vector<CString> * getFolderList()						{ return &folderList; }
 		std::vector<CString> * getWeaponList()						{ return &weaponList; }
@@ -3,9 +3,12 @@
 
 #include <vector>
 #include <map>
+#include <memory>
 #include <optional>
+#include <unordered_map>
 #include "IUtil.h"
 #include "CString.h"
+#include "CLevelCache.h"
 #include "TLevelBaddy.h"
 #include "TLevelBoardChange.h"
 #include "TLevelChest.h"
@@ -18,6 +21,13 @@ class TServer;
 class TPlayer;
 class TNPC;
 class TMap;
+class CFileSystem;
+
+#ifdef V8NPCSERVER
+// NPC lookup grid.  The 64x64 tile board is split into 16x16 cells of 4x4 tiles.
+#define NPCGRID_CELLSIZE	64		// In pixels.
+#define NPCGRID_SIZE		16
+#endif
 
 class TLevel
 {
@@ -35,19 +45,24 @@ class TLevel
 		//! \return True if it succeeds in re-loading the level.
 		bool reload();
 
-		//! Returns a clone of the level.
+		//! Returns a clone of the level.  The clone shares the tiles, links, signs
+		//! and chests of this one, and gets its own baddies and NPCs.
 		TLevel* clone();
 		
 		// get crafted packets
-		CString getBaddyPacket(int clientVersion = CLVER_2_17);
-		CString getBoardPacket();
+		// The board, links, signs, horse and baddy packets are cached until the data behind them changes.
+		const CString& getBaddyPacket(int clientVersion = CLVER_2_17);
+		const CString& getBoardPacket();
 		CString getBoardChangesPacket(time_t time);
 		CString getBoardChangesPacket2(time_t time);
 		CString getChestPacket(TPlayer *pPlayer);
-		CString getHorsePacket();
-		CString getLinksPacket();
+		const CString& getHorsePacket();
+		const CString& getLinksPacket();
 		CString getNpcsPacket(time_t time, int clientVersion = CLVER_2_17);
-		CString getSignsPacket(TPlayer *pPlayer);
+		const CString& getSignsPacket(TPlayer *pPlayer);
+
+		//! Drops the cached baddy packets.  Call when a baddy is added, removed or changed.
+		void invalidateBaddyPackets()					{ baddyPackets.clear(); }
 
 		//! Gets the actual level name.
 		//! \return The action level name.
@@ -59,11 +74,11 @@ class TLevel
 
 		//! Sets the level name.
 		//! \param pLevelName The new name of the level.
-		void setLevelName(CString pLevelName)			{ levelName = pLevelName; }
+		void setLevelName(CString pLevelName)			{ levelName = pLevelName; mapVersion = 0; }
 
 		//! Gets the raw level tile data.
 		//! \return A pointer to all 4096 raw level tiles.
-		short* getTiles()								{ return levelTiles; }
+		const short* getTiles() const					{ return levelTemplate->data.tiles; }
 
 		//! Gets the level mod time.
 		//! \return The modified time of the level when it was first loaded from the disk.
@@ -71,7 +86,7 @@ class TLevel
 
 		//! Gets a vector full of all the level chests.
 		//! \return The level chests.
-		std::vector<TLevelChest>& getLevelChests()		{ return levelChests; }
+		const std::vector<TLevelChest>& getLevelChests() const	{ return levelTemplate->data.chests; }
 
 		//! Gets a vector full of the level signs.
 		//! \return The level signs.
@@ -79,11 +94,11 @@ class TLevel
 
 		//! Gets a vector full of the level signs.
 		//! \return The level signs.
-		std::vector<TLevelSign>& getLevelSigns()		{ return levelSigns; }
+		const std::vector<TLevelSign>& getLevelSigns() const	{ return levelTemplate->signs; }
 
 		//! Gets a vector full of the level links.
 		//! \return The level links.
-		std::vector<TLevelLink>& getLevelLinks()		{ return levelLinks; }
+		const std::vector<TLevelLink>& getLevelLinks() const	{ return levelTemplate->links; }
 
 		//! Gets a vector full of the players on the level.
 		//! \return The players on the level.
@@ -184,6 +199,14 @@ class TLevel
 		//! \return The gmap this level belongs to.
 		TMap* getMap() const;
 
+		//! Gets the x position of the level on its map.
+		//! \return The x position, or 0 if the level isn't on a map.
+		int getMapX() const;
+
+		//! Gets the y position of the level on its map.
+		//! \return The y position, or 0 if the level isn't on a map.
+		int getMapY() const;
+
 		//! Adds an NPC to the level.
 		//! \param npc NPC to add to the level.
 		//! \return True if the NPC was successfully added or false if it already exists in the level.
@@ -193,10 +216,15 @@ class TLevel
 		//! \param npc The NPC to remove.
 		void removeNPC(TNPC* npc);
 
-		//! Does special events that should happen every second.
+		//! Runs the board change, item, horse and baddy events that are due.
+		//! Called by the server when the time registered with scheduleTimedEvent() is reached.
 		//! \return Currently, it always returns true.
 		bool doTimedEvents();
 
+		//! Makes sure doTimedEvents() is run no later than the given time.
+		//! \param pDue The time, from getTimerSeconds(), something in the level needs to happen.
+		void scheduleTimedEvent(long long pDue);
+
 		bool isOnWall(double pX, double pY) const;
 		bool isOnWater(double pX, double pY) const;
 		std::optional<TLevelChest> getChest(int x, int y) const;
@@ -204,6 +232,10 @@ class TLevel
 		CString getChestStr(const TLevelChest& chest) const;
 
 #ifdef V8NPCSERVER
+		//! Moves an NPC to the right cells of the NPC lookup grid.  Call when its position or shape changes.
+		//! \param npc The NPC that changed.
+		void updateNPCGrid(TNPC* npc);
+
 		std::vector<TNPC *> findAreaNpcs(int pX, int pY, int pWidth, int pHeight);
 		std::vector<TNPC*> testTouch(int pX, int pY);
 		TNPC *isOnNPC(int pX, int pY, bool checkEventFlag = false);
@@ -216,32 +248,74 @@ class TLevel
 	private:
 		TLevel(TServer* pServer);
 
+		// The parts of a level that never change once it is loaded.  Clones of a
+		// level share it.  Board changes, items, horses, baddies and NPCs are
+		// kept by each level.
+		struct SLevelTemplate
+		{
+			SLevelData data;
+			std::vector<TLevelLink> links;
+			std::vector<TLevelSign> signs;
+			CString boardPacket, linksPacket;
+		};
+
 		// level-loading functions
 		bool loadLevel(const CString& pLevelName);
-		bool detectLevelType(const CString& pLevelName);
-		bool loadGraal(const CString& pLevelName);
-		bool loadZelda(const CString& pLevelName);
-		bool loadNW(const CString& pLevelName);
+		bool readLevel(SLevelData& pData);
+		void setTemplate(const std::shared_ptr<const SLevelTemplate>& pTemplate);
+		static std::shared_ptr<const SLevelTemplate> buildTemplate(SLevelData& pData, CFileSystem* fileSystem);
+		static std::shared_ptr<const SLevelTemplate> emptyTemplate();
+		static bool parseGraal(CString& fileData, SLevelData& pData);
+		static bool parseZelda(CString& fileData, SLevelData& pData);
+		static bool parseNW(CString& fileData, SLevelData& pData);
+		static void parseTiles(CString& fileData, SLevelData& pData, int bits);
+		static void parseLinks(CString& fileData, SLevelData& pData);
+		static void parseBaddies(CString& fileData, SLevelData& pData, bool hasVerses);
+		static void parseSigns(CString& fileData, SLevelData& pData);
+		void cacheMap() const;
+		void invalidatePacketCache();
+#ifdef V8NPCSERVER
+		void addNPCToGrid(TNPC* npc);
+		void removeNPCFromGrid(TNPC* npc);
+#endif
 
 		TServer* server;
 		time_t modTime;
 		bool levelSpar;
 		bool levelSingleplayer;
-		short levelTiles[4096];
 		CString fileName, fileVersion, actualLevelName, levelName;
+		std::shared_ptr<const SLevelTemplate> levelTemplate;
 		std::vector<TLevelBaddy *> levelBaddies;
 		std::vector<TLevelBaddy *> levelBaddyIds;
 		std::vector<TLevelBoardChange *> levelBoardChanges;
-		std::vector<TLevelChest> levelChests;
 		std::vector<TLevelHorse> levelHorses;
 		std::vector<TLevelItem> levelItems;
-		std::vector<TLevelLink> levelLinks;
-		std::vector<TLevelSign> levelSigns;
 		std::vector<TNPC *> levelNPCs;
 		std::vector<TPlayer *> levelPlayerList;
 
+		// Map lookup cache, refreshed when the server reloads its maps.
+		mutable TMap* levelMap;
+		mutable int mapX, mapY;
+		mutable unsigned int mapVersion;
+		long long timedEventDue;
+
+		// Cached packets.  Empty means it needs to be rebuilt.  The board and
+		// links packets are built with the template.
+		CString horsePacket, signsPacket;
+		std::map<int, CString> baddyPackets;							// by client version
+		std::unordered_map<std::string, CString> signsPacketsByLang;	// by lowercase language
+		unsigned int signsTranslationVersion;
+
 #ifdef V8NPCSERVER
 		IScriptObject<TLevel> *_scriptObject;
+
+		// NPC lookup grid, allocated when the first NPC is added.
+		struct SNPCGridArea
+		{
+			int left, top, right, bottom;
+		};
+		std::vector<std::vector<TNPC *> > npcGrid;
+		std::unordered_map<TNPC *, SNPCGridArea> npcGridAreas;
 #endif
 };
 
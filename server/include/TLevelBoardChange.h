@@ -3,7 +3,7 @@
 
 #include <vector>
 #include <time.h>
-#include "CTimeout.h"
+#include "CTimerWheel.h"
 #include "CString.h"
 
 class TLevelBoardChange
@@ -30,7 +30,7 @@ class TLevelBoardChange
 		// set private variables
 		void setModTime(time_t ntime)	{ modTime = ntime; }
 
-		CTimeout timeout;
+		CDeadline timeout;
 
 	private:
 		int x, y, width, height;
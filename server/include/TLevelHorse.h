@@ -2,7 +2,7 @@
 #define TLEVELHORSE_H
 
 #include "CString.h"
-#include "CTimeout.h"
+#include "CTimerWheel.h"
 
 class TServer;
 class TLevelHorse
@@ -23,7 +23,7 @@ class TLevelHorse
 		char getDir() const			{ return dir; }
 		char getBushes() const		{ return bushes; }
 
-		CTimeout timeout;
+		CDeadline timeout;
 
 	private:
 		CString image;
@@ -2,7 +2,7 @@
 #define TLEVELITEM_H
 
 #include <time.h>
-#include "CTimeout.h"
+#include "CTimerWheel.h"
 #include "CString.h"
 
 class TPlayer;
@@ -26,7 +26,7 @@ class TLevelItem
 		signed char getItem() const	{ return item; }
 		time_t getModTime() const	{ return modTime; }
 
-		CTimeout timeout;
+		CDeadline timeout;
 
 	private:
 		float x;
@@ -2,6 +2,9 @@
 #define TGMAP_H
 
 #include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
 #include <time.h>
 #include "CString.h"
 
@@ -33,6 +36,7 @@ struct SMapLevel
 };
 
 class TServer;
+class TPlayer;
 
 class TMap
 {
@@ -53,10 +57,18 @@ class TMap
 		int getHeight() const				{ return height; }
 		bool isGroupMap() const				{ return groupMap; }
 		CString getLevels();
+		const std::unordered_map<std::string, SMapLevel>& getMapLevels() const	{ return levels; }
+
+		// Players on this map, bucketed by the map cell they occupy.
+		void setPlayerCell(TPlayer* player, int x, int y);
+		void removePlayer(TPlayer* player);
+		const std::vector<TPlayer*>* getPlayersAt(int x, int y) const;
 
 	private:
 		bool loadBigMap(const CString& pFileName, TServer* pServer);
 		bool loadGMap(const CString& pFileName, TServer* pServer);
+		void buildLevelGrid();
+		static int getCellKey(int x, int y);
 
 		int type;
 		CString mapName;
@@ -67,7 +79,24 @@ class TMap
 		CString mapImage;
 		CString miniMapImage;
 		//bool loadFullMap;
-		std::map<CString, SMapLevel> levels;
+		std::unordered_map<std::string, SMapLevel> levels;
+		std::vector<CString> levelGrid;
+		int gridWidth, gridHeight;
+		std::unordered_map<int, std::vector<TPlayer*> > playerCells;
+		std::unordered_map<TPlayer*, int> playerCellKeys;
 };
 
+inline int TMap::getCellKey(int x, int y)
+{
+	return ((y & 0xFFFF) << 16) | (x & 0xFFFF);
+}
+
+inline const std::vector<TPlayer*>* TMap::getPlayersAt(int x, int y) const
+{
+	auto it = playerCells.find(getCellKey(x, y));
+	if (it == playerCells.end())
+		return nullptr;
+	return &it->second;
+}
+
 #endif
@@ -212,10 +212,10 @@ class TNPC
 		// set functions
 		void setId(unsigned int pId)			{ id = pId; }
 		void setLevel(TLevel* pLevel)			{ level = pLevel; }
-		void setX(float val)					{ x = val; x2 = (int)(16 * val); }
-		void setY(float val)					{ y = val; y2 = (int)(16 * val); }
-		void setHeight(int val)					{ height = val; }
-		void setWidth(int val)					{ width = val; }
+		void setX(float val)					{ x = val; x2 = (int)(16 * val); updateLevelGrid(); }
+		void setY(float val)					{ y = val; y2 = (int)(16 * val); updateLevelGrid(); }
+		void setHeight(int val)					{ height = val; updateLevelGrid(); }
+		void setWidth(int val)					{ width = val; updateLevelGrid(); }
 		void setName(const std::string& name)	{ npcName = name; }
 		void setScripter(const CString& name)	{ npcScripter = name; }
 		void setType(const CString& type)		{ npcType = type; }
@@ -286,6 +286,7 @@ class TNPC
 		bool getPersist() const			{ return persistNpc; }
 		void setPersist(bool persist)	{ persistNpc = persist; }
 		bool loadNPC(const CString& fileName);
+		bool loadNPCData(CString fileData);
 		void saveNPC();
 
 		void queueNpcAction(const std::string& action, TPlayer *player = 0, bool registerAction = true);
@@ -305,6 +306,8 @@ class TNPC
 #endif
 
 	private:
+		void updateLevelGrid();
+
 		bool blockPositionUpdates;
 		bool levelNPC;
 		time_t modTime[NPCPROP_COUNT];
@@ -2,11 +2,18 @@
 #define TPLAYER_H
 
 #include <time.h>
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
 #include <map>
+#include <memory>
 #include <set>
 #include <vector>
 #include "IEnums.h"
 #include "CFileQueue.h"
+#include "CFileCache.h"
 #include "TAccount.h"
 #include "CEncryption.h"
 #include "CSocket.h"
@@ -21,6 +28,26 @@ class TMap;
 class TWeapon;
 //class CFileQueue;
 
+// File downloads are streamed off disk in chunks of FILESEND_CHUNKSIZE bytes, with
+// at most FILESEND_WINDOW chunks waiting in the send queue at once.
+#define FILESEND_CHUNKSIZE	FILECACHE_CHUNKSIZE
+#define FILESEND_WINDOW		4
+
+// Outgoing packets wait in one of these lanes until they are moved into the
+// file queue.  Lanes share the connection by weight (see outLaneWeights).
+enum
+{
+	OUTLANE_REALTIME = 0,	// Movement of other players.  Newer positions replace unsent ones.
+	OUTLANE_NORMAL,			// Everything else.
+	OUTLANE_BULK,			// File transfers.
+	OUTLANE_COUNT
+};
+
+// Bytes a lane may move per round for each point of weight, and how much we
+// move into the file queue at a time.
+#define OUTLANE_QUANTUM		8192
+#define OUTLANE_BUDGET		65536
+
 struct SCachedLevel
 {
 	SCachedLevel(TLevel* pLevel, time_t pModTime) : level(pLevel), modTime(pModTime) { }
@@ -70,7 +97,7 @@ class TPlayer : public TAccount, public CSocketStub
 		void setGroup(CString group)	{ levelGroup = group; }
 		void deleteFlag(const std::string& pFlagName, bool sendToPlayer = false);
 		void setFlag(const std::string& pFlagName, const CString& pFlagValue, bool sendToPlayer = false);
-		void setMap(TMap* map)			{ pmap = map; }
+		void setMap(TMap* map);
 		void setServerName(CString& tmpServerName)	{ serverName = tmpServerName; }
 
 		// Level manipulation
@@ -94,7 +121,9 @@ class TPlayer : public TAccount, public CSocketStub
 
 		// Socket-Functions
 		bool doMain();
-		void sendPacket(CString pPacket, bool appendNL = true);
+		bool receiveData(const char* pData, unsigned int pSize);
+		bool parseDecoded();
+		void sendPacket(const CString& pPacket, bool appendNL = true);
 		bool sendFile(const CString& pFile);
 		bool sendFile(const CString& pPath, const CString& pFile);
 
@@ -313,6 +342,7 @@ class TPlayer : public TAccount, public CSocketStub
 
 	private:
 		// Login functions.
+		bool finishLogin(std::vector<CString>& pAccountData, bool pLoadedFromDefault);
 		bool sendLoginClient();
 		bool sendLoginNC();
 		bool sendLoginRC();
@@ -320,6 +350,9 @@ class TPlayer : public TAccount, public CSocketStub
 		// Packet functions.
 		bool parsePacket(CString& pPacket);
 		void decryptPacket(CString& pPacket);
+		void decodeFrame(CString& pFrame);
+		void decodeFrames(std::vector<CString>& pFrames);
+		void finishParsing();
 
 		// Collision detection stuff.
 		bool testSign();
@@ -327,6 +360,16 @@ class TPlayer : public TAccount, public CSocketStub
 
 		// Misc.
 		void dropItemsOnDeath();
+		void updateMapCell();
+		void sendFileChunks();
+
+		// Outgoing data.
+		void queueOutgoing(const CString& pPacket);
+		void moveOutgoingToQueue(bool pAll = false);
+		bool isOutLaneEmpty(int pLane);
+		bool isOutLanesEmpty();
+		void flushOutgoing();
+		bool isSocketDisconnected();
 
 		// Socket Variables
 		CSocket *playerSock;
@@ -344,10 +387,29 @@ class TPlayer : public TAccount, public CSocketStub
 		time_t lastData, lastMovement, lastChat, lastNick, lastMessage, lastSave, last1m;
 		std::vector<SCachedLevel*> cachedLevels;
 		std::map<CString, CString> rcLargeFiles;
+
+		// Where our last /sendstats left off.
+		unsigned long long sendStatsCount;
+		std::chrono::steady_clock::time_point sendStatsSince;
+
+		// Files being sent to us.  Cached files are sent from memory, anything else
+		// is opened once it reaches the front.
+		struct SFileTransfer
+		{
+			CString path, name;
+			std::shared_ptr<const SCachedFile> cached;
+			FILE* file;
+			long long size, offset;
+			time_t modTime;
+			bool isBigFile;
+		};
+		std::deque<SFileTransfer> fileTransfers;
 		std::map<CString, TLevel*> spLevels;
 		std::set<std::string> channelList;
 		std::vector<TPlayer *> externalPlayerIds, externalPlayerList;
 		TMap* pmap;
+		TMap* cellMap;
+		int mapCellX, mapCellY;
 		unsigned int carryNpcId;
 		bool carryNpcThrown;
 		CString guild;
@@ -366,7 +428,41 @@ class TPlayer : public TAccount, public CSocketStub
 		CString grExecParameterList;
 
 		// File queue.
+		// Packets wait in the out lanes until the file queue has drained, then
+		// the lanes are moved into it by deficit round robin.  With send workers
+		// running, a worker does the moving, compressing, encrypting and sending.
+		// fileQueueLock keeps the workers and the server thread out of the queue at the same time.
+		// Sending can disconnect playerSock, so every use of the socket goes under it too.
+		struct SOutPacket
+		{
+			CString header;				// PLO_RAWDATA announcing the packet, if any
+			CString packet;
+			short playerId;				// The player the packet is about, or -1
+			unsigned char movement;		// Realtime lane only, the movement props in the packet
+		};
 		CFileQueue fileQueue;
+		std::mutex outLock, fileQueueLock;
+		std::deque<SOutPacket> outLanes[OUTLANE_COUNT];
+		int outDeficit[OUTLANE_COUNT];
+		std::map<short, SOutPacket*> outMovement;		// Unsent movement, by player id
+		std::map<short, int> outPlayerPackets;			// Unsent normal lane packets, by player id
+		CString outRawHeader;
+		std::atomic_bool outQueued, outBacklog;
+
+		// Incoming frames are decrypted and decompressed by a socket worker once
+		// we are logged in.  The resulting packets wait in inDecoded to be parsed.
+		std::mutex inLock;
+		std::vector<CString> inDecoded;
+
+		// The account file is read by a socket worker too.  Until it is back the
+		// login is pending, and anything the player sends waits in inDecoded.
+		struct SAccountLoad
+		{
+			std::vector<CString> fileData;
+			bool loadedFromDefault;
+		};
+		std::shared_ptr<SAccountLoad> accountLoad;
+		bool loginPending;
 
 #ifdef V8NPCSERVER
 		bool _processRemoval;
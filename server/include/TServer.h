@@ -1,24 +1,29 @@
 #ifndef TSERVER_H
 #define TSERVER_H
 
+#include <deque>
 #include <vector>
 #include <map>
 #include <unordered_map>
 #include <set>
+#include <string>
+#include <unordered_set>
 #include <thread>
+#include <atomic>
+#include <mutex>
 #include <chrono>
 #include <climits>
-#ifdef V8NPCSERVER
-#include <string>
-#include <unordered_set>
-#endif
 
 #include "IEnums.h"
 #include "CString.h"
 #include "CLog.h"
 #include "CFileSystem.h"
+#include "CFileWatcher.h"
 #include "CSettings.h"
 #include "CSocket.h"
+#include "CSocketReactor.h"
+#include "CTimerWheel.h"
+#include "CWorkerPool.h"
 #include "CTranslationManager.h"
 #include "CWordFilter.h"
 #include "TServerList.h"
@@ -58,6 +63,19 @@ enum
 };
 #define FS_COUNT	7
 
+// After a restart every player reconnects at once.  Take at most this many new
+// connections off the listen socket, and create at most this many players from
+// them, per main loop iteration so the players already on aren't held up.
+// Once SERVER_ACCEPT_WAITING accepted connections are waiting for a player, stop
+// accepting and leave the rest in the kernel's backlog until we catch up.
+#define SERVER_ACCEPT_BATCH		64
+#define SERVER_ACCEPT_PLAYERS	16
+#define SERVER_ACCEPT_WAITING	128
+
+// Most level names remembered as missing.  Clients choose the names, so the
+// list is dropped and started over once it gets this big.
+#define SERVER_MISSINGLEVELS	4096
+
 class TServer : public CSocketStub
 {
 	public:
@@ -98,8 +116,11 @@ class TServer : public CSocketStub
 		void loadTranslations();
 		void loadWordFilter();
 
-		void loadAllFolders();
-		void loadFolderConfig();
+		// Directories and wildcards to add to each file system.
+		typedef std::vector<std::pair<CString, CString> > FolderList;
+		void loadAllFolders(FolderList* pFolders);
+		void loadFolderConfig(FolderList* pFolders);
+		void preloadLevels(bool print = false);
 
 		void saveServerFlags();
 		void saveWeapons();
@@ -123,7 +144,7 @@ class TServer : public CSocketStub
 #endif
 		CSettings* getSettings()						{ return &settings; }
 		CSettings* getAdminSettings()					{ return &adminsettings; }
-		CSocketManager* getSocketManager()				{ return &sockManager; }
+		CSocketReactor* getSocketManager()				{ return &sockManager; }
 		CString getServerPath()							{ return serverpath; }
 		CString* getServerMessage()						{ return &servermessage; }
 		CString* getAllowedVersionString()				{ return &allowedVersionString; }
@@ -140,10 +161,20 @@ class TServer : public CSocketStub
 		std::vector<TPlayer *>* getPlayerList()			{ return &playerList; }
 		std::vector<TNPC *>* getNPCList()				{ return &npcList; }
 		std::vector<TLevel *>* getLevelList()			{ return &levelList; }
+		std::unordered_map<std::string, TLevel *>* getLevelIndex()	{ return &levelIndex; }
+		std::unordered_set<std::string>* getMissingLevels()	{ return &missingLevels; }
 		std::vector<TMap *>* getMapList()				{ return &mapList; }
+		unsigned int getMapListVersion() const			{ return mapListVersion; }
+		unsigned int getTranslationVersion() const		{ return translationVersion; }
 		std::vector<CString>* getStatusList()			{ return &statusList; }
 		std::vector<CString>* getAllowedVersions()		{ return &allowedVersions; }
 		std::map<CString, std::map<CString, TLevel*> >* getGroupLevels()	{ return &groupLevels; }
+		CTimerWheel* getLevelTimers()					{ return &levelTimers; }
+		CWorkerPool* getSocketWorkers()					{ return &socketWorkers; }
+
+		// send() calls made for game clients since startup, for /sendstats.
+		std::atomic<unsigned long long>* getClientSendCounter()	{ return &clientSends; }
+		unsigned long long getClientSends() const		{ return clientSends; }
 
 #ifdef V8NPCSERVER
 		CScriptEngine * getScriptEngine() { return &mScriptEngine; }
@@ -190,10 +221,11 @@ class TServer : public CSocketStub
 		inline void sendToNC(const CString& pMessage, TPlayer *pPlayer = 0) const;
 
 		// Packet sending.
-		void sendPacketToAll(CString pPacket, TPlayer *pPlayer) const;
-		void sendPacketToLevel(CString pPacket, TMap* pMap, TLevel* pLevel, TPlayer* pPlayer = 0, bool onlyGmap = false) const;
-		void sendPacketToLevel(CString pPacket, TMap* pMap, TPlayer* pPlayer, bool sendToSelf = false, bool onlyGmap = false) const;
-		void sendPacketTo(int who, CString pPacket, TPlayer* pPlayer = 0) const;
+		// The packet is newline terminated once and then shared by every recipient.
+		void sendPacketToAll(const CString& pPacket, TPlayer *pPlayer) const;
+		void sendPacketToLevel(const CString& pPacket, TMap* pMap, TLevel* pLevel, TPlayer* pPlayer = 0, bool onlyGmap = false) const;
+		void sendPacketToLevel(const CString& pPacket, TMap* pMap, TPlayer* pPlayer, bool sendToSelf = false, bool onlyGmap = false) const;
+		void sendPacketTo(int who, const CString& pPacket, TPlayer* pPlayer = 0) const;
 
 		// Player Management
 		unsigned int getFreePlayerId();
@@ -201,6 +233,10 @@ class TServer : public CSocketStub
 		bool deletePlayer(TPlayer* player);
 		void playerLoggedIn(TPlayer *player);
 
+		// Players with packets decoded by a socket worker, waiting to be parsed.
+		void addDecodedPlayer(TPlayer *player);
+		void removeDecodedPlayer(TPlayer *player);
+
 		// Translation Management
 		bool TS_Load(const CString& pLanguage, const CString& pFileName);
 		CString TS_Translate(const CString& pLanguage, const CString& pKey);
@@ -217,17 +253,22 @@ class TServer : public CSocketStub
 		bool doTimedEvents();
 		void acceptSock(CSocket& pSocket);
 		void cleanupDeletedPlayers();
+		void addAcceptedPlayers();
+		void watchFileSystems();
+		void parseDecodedPlayers();
 
 		bool doRestart;
 
 		CFileSystem filesystem[FS_COUNT], filesystem_accounts;
+		CFileWatcher fileWatcher;
 		CLog npclog, rclog, serverlog; //("logs/npclog|rclog|serverlog.txt");
 #ifdef V8NPCSERVER
 		CLog scriptlog;
 #endif
 		CSettings adminsettings, settings;
 		CSocket playerSock;
-		CSocketManager sockManager;
+		CSocketReactor sockManager;
+		CWorkerPool socketWorkers;
 		CString allowedVersionString, name, servermessage, serverpath;
 		CTranslationManager mTranslationManager;
 		CWordFilter wordFilter;
@@ -240,11 +281,20 @@ class TServer : public CSocketStub
 		std::unordered_map<std::string, TNPC *> npcNameList;
 		std::vector<CString> allowedVersions, foldersConfig, ipBans, statusList, staffList;
 		std::vector<TLevel *> levelList;
+		std::unordered_map<std::string, TLevel *> levelIndex;	// lowercase level name -> level
+		std::unordered_set<std::string> missingLevels;			// lowercase names that failed to load
 		std::vector<TMap *> mapList;
+		std::unordered_map<std::string, TMap *> levelMaps;	// level name -> map it is on
+		unsigned int mapListVersion, translationVersion;
+		CTimerWheel levelTimers;						// levels with pending timed events
+		std::atomic<unsigned long long> clientSends;
 		std::vector<TNPC *> npcIds, npcList;
 		std::vector<TPlayer *> playerIds, playerList;
 
 		std::set<TPlayer *> deletedPlayers;
+		std::deque<CSocket *> acceptedSockets;		// accepted, but no player yet
+		std::mutex decodedLock;
+		std::vector<TPlayer *> decodedPlayers;
 
 		TServerList serverlist;
 		std::chrono::high_resolution_clock::time_point lastTimer, lastNWTimer, last1mTimer, last5mTimer, last3mTimer;
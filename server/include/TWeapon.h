@@ -14,6 +14,17 @@ class TPlayer;
 #endif
 
 class TServer;
+
+// A weapon file as read from disk, before the weapon is created.
+struct SWeaponFile
+{
+	SWeaponFile() : malformed(false) { }
+
+	CString name, image, script, byteCodeFile;
+	std::vector<std::pair<CString, CString> > byteCode;
+	bool malformed;
+};
+
 class TWeapon
 {
 	public:
@@ -28,6 +39,13 @@ class TWeapon
 
 		static TWeapon* loadWeapon(const CString& pWeapon, TServer* server);
 
+		//! Reads and parses a weapon file.  Only touches the disk, so it can
+		//! run on a worker thread.
+		static bool readWeapon(const CString& pWeapon, TServer* server, SWeaponFile& pFile);
+
+		//! Creates the weapon from a file read by readWeapon().
+		static TWeapon* createWeapon(const SWeaponFile& pFile, TServer* server);
+
 		// Functions -> Inline Get-Functions
 		CString getWeaponPacket() const;
 		inline bool isDefault() const					{ return (mWeaponDefault != -1); }
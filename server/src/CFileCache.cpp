@@ -0,0 +1,195 @@
+#include "IDebug.h"
+#include <algorithm>
+#include "CFileCache.h"
+#include "IEnums.h"
+
+CFileCache& CFileCache::shared()
+{
+	static CFileCache cache;
+	return cache;
+}
+
+CFileCache::CFileCache()
+	: bytes(0), byteLimit(FILECACHE_DEFAULTSIZE), hits(0), misses(0), evictions(0)
+{
+}
+
+std::shared_ptr<const SCachedFile> CFileCache::get(const CString& pPath, time_t pModTime, long long pSize)
+{
+	if (pSize <= 0 || pSize > FILECACHE_MAXENTRY)
+		return nullptr;
+
+	std::string key(pPath.text());
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		if ((size_t)pSize > byteLimit)
+			return nullptr;
+
+		auto it = fileIndex.find(key);
+		if (it != fileIndex.end())
+		{
+			const auto& file = it->second->second;
+			if (file->modTime == pModTime && file->size == pSize)
+			{
+				++hits;
+				lruList.splice(lruList.begin(), lruList, it->second);
+				return file;
+			}
+
+			// Changed on disk, drop the old copy.
+			bytes -= entryBytes(file.get());
+			lruList.erase(it->second);
+			fileIndex.erase(it);
+		}
+		++misses;
+	}
+
+	// Read the file without holding the lock.
+	auto file = std::make_shared<SCachedFile>();
+	if (!file->data.load(pPath) || file->data.length() == 0)
+		return nullptr;
+
+	// Changed since the caller looked at it.  We don't know the mod time of
+	// what we read, and the caller has the wrong size, so don't use it.
+	if (file->data.length() != pSize)
+		return nullptr;
+	file->path = key;
+	file->modTime = pModTime;
+	file->size = pSize;
+	file->chunkBytes = 0;
+
+	std::lock_guard<std::mutex> lock(m_lock);
+
+	// Another server may have loaded it while we were reading.
+	auto it = fileIndex.find(key);
+	if (it != fileIndex.end())
+	{
+		bytes -= entryBytes(it->second->second.get());
+		lruList.erase(it->second);
+		fileIndex.erase(it);
+	}
+
+	lruList.emplace_front(key, file);
+	fileIndex[key] = lruList.begin();
+	bytes += (size_t)file->size;
+	evict();
+
+	return file;
+}
+
+std::shared_ptr<const SCachedChunk> CFileCache::getChunk(const std::shared_ptr<const SCachedFile>& pFile, size_t pIndex, const CString& pName, bool pCompress)
+{
+	size_t offset = pIndex * FILECACHE_CHUNKSIZE;
+	if (!pFile || offset >= (size_t)pFile->size)
+		return nullptr;
+
+	std::shared_ptr<const SCachedChunk> chunk;
+	size_t added = 0;
+	{
+		std::lock_guard<std::mutex> lock(pFile->chunkLock);
+
+		// The name is part of the packet, so only one name gets cached.
+		if (pFile->chunkName.isEmpty())
+			pFile->chunkName = pName;
+		else if (pFile->chunkName != pName)
+			return nullptr;
+
+		if (pFile->chunks.empty())
+			pFile->chunks.resize((size_t)((pFile->size + FILECACHE_CHUNKSIZE - 1) / FILECACHE_CHUNKSIZE));
+
+		chunk = pFile->chunks[pIndex];
+		if (chunk && (!pCompress || !chunk->zlib.isEmpty()))
+			return chunk;
+
+		// Chunks can be in use by other downloads, so build a new one instead
+		// of filling in the old one.
+		auto built = std::make_shared<SCachedChunk>();
+		if (chunk)
+		{
+			built->header = chunk->header;
+			built->packet = chunk->packet;
+		}
+		else
+		{
+			int chunkSize = (int)std::min((long long)FILECACHE_CHUNKSIZE, pFile->size - (long long)offset);
+
+			// 1 (PLO_FILE) + 5 (modTime) + 1 (file.length()) + file.length() + 1 (\n)
+			int packetLength = 1 + 5 + 1 + pName.length() + 1;
+			built->header >> (char)PLO_RAWDATA >> (int)(packetLength + chunkSize) << "\n";
+			built->packet >> (char)PLO_FILE >> (long long)pFile->modTime >> (char)pName.length() << pName;
+			built->packet.write(pFile->data.text() + offset, chunkSize);
+			built->packet << "\n";
+			added += built->header.length() + built->packet.length();
+		}
+
+		if (pCompress)
+		{
+			CString framed = CString() << built->header << built->packet;
+			built->zlib = framed.zcompress();
+			built->bz2 = framed.bzcompress();
+			added += built->zlib.length() + built->bz2.length();
+		}
+
+		chunk = built;
+		pFile->chunks[pIndex] = chunk;
+	}
+
+	addChunkBytes(pFile.get(), added);
+	return chunk;
+}
+
+void CFileCache::addChunkBytes(const SCachedFile* pFile, size_t pBytes)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	pFile->chunkBytes += pBytes;
+
+	// Only count it if the file is still cached.  Otherwise it goes away
+	// with the last download using it.
+	auto it = fileIndex.find(pFile->path);
+	if (it != fileIndex.end() && it->second->second.get() == pFile)
+	{
+		bytes += pBytes;
+		evict();
+	}
+}
+
+void CFileCache::setByteLimit(size_t pBytes)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	byteLimit = pBytes;
+	evict();
+}
+
+void CFileCache::clear()
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	lruList.clear();
+	fileIndex.clear();
+	bytes = 0;
+}
+
+SFileCacheStats CFileCache::getStats()
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	SFileCacheStats stats;
+	stats.hits = hits;
+	stats.misses = misses;
+	stats.evictions = evictions;
+	stats.bytes = bytes;
+	stats.byteLimit = byteLimit;
+	stats.files = fileIndex.size();
+	return stats;
+}
+
+void CFileCache::evict()
+{
+	// Downloads still using an evicted file keep their own reference to it.
+	while (bytes > byteLimit && !lruList.empty())
+	{
+		auto& oldest = lruList.back();
+		bytes -= entryBytes(oldest.second.get());
+		fileIndex.erase(oldest.first);
+		lruList.pop_back();
+		++evictions;
+	}
+}
@@ -21,14 +21,20 @@
 	#endif
 #endif
 
+CFileSystem::SSnapshot::SSnapshot()
+{
+	for (auto& shard : shards)
+		shard = getEmptyShard();
+}
+
 CFileSystem::CFileSystem()
-: server(nullptr)
+: server(nullptr), snapshot(std::make_shared<SSnapshot>()), pendingChanged(false), updateDepth(0)
 {
 	m_preventChange = new std::recursive_mutex();
 }
 
 CFileSystem::CFileSystem(TServer* pServer)
-: server(pServer)
+: server(pServer), snapshot(std::make_shared<SSnapshot>()), pendingChanged(false), updateDepth(0)
 {
 	m_preventChange = new std::recursive_mutex();
 }
@@ -41,8 +47,118 @@ CFileSystem::~CFileSystem()
 
 void CFileSystem::clear()
 {
-	fileList.clear();
+	std::lock_guard<std::recursive_mutex> lock(*m_preventChange);
+
+	// Start over from an empty file list.  Inside an update this isn't
+	// published until the outermost endUpdate(), so a rebuild can clear and
+	// reload without readers ever seeing an empty or half loaded list.
+	beginUpdate();
+	clearPending();
 	dirList.clear();
+	endUpdate();
+}
+
+void CFileSystem::beginUpdate()
+{
+	m_preventChange->lock();
+
+	// Changes go into copies of the shards they touch.  Readers keep using the old ones.
+	if (updateDepth++ == 0)
+	{
+		auto snap = getSnapshot();
+		for (int i = 0; i < FILESYSTEM_SHARDS; ++i)
+			pendingBase[i] = snap->shards[i];
+	}
+}
+
+void CFileSystem::endUpdate()
+{
+	// Publish the changes.  Readers still holding the old list keep it alive
+	// until they are done with it.
+	if (--updateDepth == 0)
+	{
+		if (pendingChanged)
+		{
+			auto snap = std::make_shared<SSnapshot>();
+			for (int i = 0; i < FILESYSTEM_SHARDS; ++i)
+			{
+				if (pendingCopy[i])
+					snap->shards[i] = std::move(pendingCopy[i]);
+				else snap->shards[i] = pendingBase[i];
+			}
+			std::atomic_store(&snapshot, std::shared_ptr<const SSnapshot>(std::move(snap)));
+		}
+
+		for (int i = 0; i < FILESYSTEM_SHARDS; ++i)
+		{
+			pendingBase[i].reset();
+			pendingCopy[i].reset();
+		}
+		pendingChanged = false;
+	}
+
+	m_preventChange->unlock();
+}
+
+const std::shared_ptr<const CFileSystem::SShard>& CFileSystem::getEmptyShard()
+{
+	static const std::shared_ptr<const SShard> empty = std::make_shared<SShard>();
+	return empty;
+}
+
+unsigned int CFileSystem::getShard(const std::string& lowerName)
+{
+	return (unsigned int)(std::hash<std::string>()(lowerName) % FILESYSTEM_SHARDS);
+}
+
+const CFileSystem::SShard& CFileSystem::getPendingShard(unsigned int shard) const
+{
+	if (pendingCopy[shard])
+		return *pendingCopy[shard];
+	return *pendingBase[shard];
+}
+
+CFileSystem::SShard& CFileSystem::changePendingShard(unsigned int shard)
+{
+	// Copy it the first time it changes in this update.
+	if (!pendingCopy[shard])
+		pendingCopy[shard] = std::make_shared<SShard>(*pendingBase[shard]);
+	pendingChanged = true;
+	return *pendingCopy[shard];
+}
+
+CString CFileSystem::getPendingPath(const CString& name) const
+{
+	const FileList& fileList = getPendingShard(getShard(name.toLower().text())).fileList;
+	auto i = fileList.find(name);
+	if (i == fileList.end()) return CString();
+	return CString(i->second);
+}
+
+void CFileSystem::clearPending()
+{
+	for (int i = 0; i < FILESYSTEM_SHARDS; ++i)
+	{
+		pendingBase[i] = getEmptyShard();
+		pendingCopy[i].reset();
+	}
+	pendingChanged = true;
+}
+
+std::shared_ptr<const CFileSystem::FileList> CFileSystem::getFileList() const
+{
+	// Merging the shards is slow, so keep the result for as long as the
+	// snapshot is current.  It is only wanted for searches and listings.
+	auto snap = getSnapshot();
+	std::lock_guard<std::mutex> lock(snap->fileListLock);
+	if (!snap->fileList)
+	{
+		auto fileList = std::make_shared<FileList>();
+		for (const auto& shard : snap->shards)
+			fileList->insert(shard->fileList.begin(), shard->fileList.end());
+		snap->fileList = std::move(fileList);
+	}
+	return snap->fileList;
 }
 
 void CFileSystem::addDir(const CString& dir, const CString& wildcard, bool forceRecursive)
@@ -70,14 +186,14 @@ void CFileSystem::addDir(const CString& dir, const CString& wildcard, bool force
 		dirList.push_back(ndir);
 
 		// Load up the files in the directory.
+		beginUpdate();
 		loadAllDirectories(ndir, (forceRecursive ? true : server->getSettings()->getBool("nofoldersconfig", false)));
+		endUpdate();
 	}
 }
 
 void CFileSystem::addFile(CString file)
 {
-	std::lock_guard<std::recursive_mutex> lock(*m_preventChange);
-
 	// Grab the file name and directory.
 	CFileSystem::fixPathSeparators(file);
 	CString filename(file.subString(file.findl(fSep) + 1));
@@ -88,13 +204,13 @@ void CFileSystem::addFile(CString file)
 		directory.removeI(0, server->getServerPath().length());
 
 	// Add to the map.
-	fileList[filename] = CString() << server->getServerPath() << directory << filename;
+	beginUpdate();
+	setFile(filename, CString() << server->getServerPath() << directory << filename);
+	endUpdate();
 }
 
 void CFileSystem::removeFile(const CString& file)
 {
-	std::lock_guard<std::recursive_mutex> lock(*m_preventChange);
-
 	// Grab the file name and directory.
 	CString filename(file.subString(file.findl(fSep) + 1));
 	CString directory(file.subString(0, file.find(filename)));
@@ -103,46 +219,207 @@ void CFileSystem::removeFile(const CString& file)
 	CFileSystem::fixPathSeparators(directory);
 
 	// Remove it from the map.
-	fileList.erase(filename);
+	beginUpdate();
+	unsetFile(filename);
+	endUpdate();
 }
 
 void CFileSystem::resync()
 {
 	std::lock_guard<std::recursive_mutex> lock(*m_preventChange);
 
-	// Clear the file list.
-	fileList.clear();
+	// Start from an empty file list instead of a copy of the current one.
+	beginUpdate();
+	clearPending();
 
 	// Iterate through all the directories, reloading their file list.
 	for (std::vector<CString>::const_iterator i = dirList.begin(); i != dirList.end(); ++i)
 		loadAllDirectories(*i, server->getSettings()->getBool("nofoldersconfig", false));
+
+	endUpdate();
 }
 
-CString CFileSystem::find(const CString& file) const
+void CFileSystem::fileAdded(const CString& pDirectory, const CString& pName)
 {
 	std::lock_guard<std::recursive_mutex> lock(*m_preventChange);
 
-	std::map<CString, CString>::const_iterator i = fileList.find(file);
-	if (i == fileList.end()) return CString();
-	return CString(i->second);
+	// Not something this file system has asked for.
+	int order = getDirOrder(pDirectory, pName);
+	if (order == -1)
+		return;
+
+	// If it is a level somebody asked for before, it isn't missing any more.
+	if (server != nullptr)
+		server->getMissingLevels()->erase(std::string(pName.toLower().text()));
+
+	beginUpdate();
+
+	// Already have it, like a new account that was added when it was saved.
+	CString path = CString() << pDirectory << pName;
+	CString current = getPendingPath(pName);
+	if (current == path)
+	{
+		endUpdate();
+		return;
+	}
+
+	// When two directories have the same file, a full scan ends up with the
+	// one from the directory loaded last.  Keep it that way.
+	if (!current.isEmpty())
+	{
+		CString otherDirectory = current.subString(0, current.length() - pName.length());
+		if (getDirOrder(otherDirectory, pName) > order)
+		{
+			endUpdate();
+			return;
+		}
+	}
+
+	setFile(pName, path);
+	endUpdate();
 }
 
-CString CFileSystem::findi(const CString& file) const
+void CFileSystem::fileRemoved(const CString& pDirectory, const CString& pName)
 {
 	std::lock_guard<std::recursive_mutex> lock(*m_preventChange);
 
-	for (std::map<CString, CString>::const_iterator i = fileList.begin(); i != fileList.end(); ++i)
-		if (i->first.comparei(file)) return CString(i->second);
-	return CString();
+	// Check the list being changed, earlier changes in this batch aren't
+	// published yet.
+	beginUpdate();
+	CString path = CString() << pDirectory << pName;
+	if (getPendingPath(pName) != path)
+	{
+		endUpdate();
+		return;
+	}
+
+	// Another directory could have a file by the same name that was hidden by
+	// this one.  Use it instead, the last one like a full scan would.
+	CString name(pName), replacement;
+	for (const auto& entry : dirList)
+	{
+		int sep = entry.findl(fSep);
+		CString directory = entry.remove(sep + 1);
+		if (directory == pDirectory || !name.match(entry.subString(sep + 1)))
+			continue;
+
+		struct stat fileStat;
+		CString otherPath = CString() << directory << pName;
+		if (stat(otherPath.text(), &fileStat) == 0 && !(fileStat.st_mode & S_IFDIR))
+			replacement = otherPath;
+	}
+
+	if (!replacement.isEmpty())
+		setFile(pName, replacement);
+	else unsetFile(pName);
+	endUpdate();
+}
+
+int CFileSystem::getDirOrder(const CString& pDirectory, const CString& pName) const
+{
+	// Position of the last directory entry that would have loaded the file.
+	CString name(pName);
+	int order = -1;
+	for (int i = 0; i < (int)dirList.size(); ++i)
+	{
+		const CString& entry = dirList[i];
+		int sep = entry.findl(fSep);
+		if (sep + 1 != pDirectory.length() || entry.remove(sep + 1) != pDirectory)
+			continue;
+		if (name.match(entry.subString(sep + 1)))
+			order = i;
+	}
+	return order;
+}
+
+CString CFileSystem::find(const CString& file) const
+{
+	auto snap = getSnapshot();
+	const SShard& shard = *snap->shards[getShard(file.toLower().text())];
+	auto i = shard.fileList.find(file);
+	if (i == shard.fileList.end()) return CString();
+	return CString(i->second);
+}
+
+CString CFileSystem::findi(const CString& file) const
+{
+	auto snap = getSnapshot();
+	std::string key(file.toLower().text());
+	const SShard& shard = *snap->shards[getShard(key)];
+	auto i = shard.fileIndex.find(key);
+	if (i == shard.fileIndex.end()) return CString();
+	return CString(shard.fileList.find(i->second.name)->second);
 }
 
 CString CFileSystem::fileExistsAs(const CString& file) const
 {
-	std::lock_guard<std::recursive_mutex> lock(*m_preventChange);
+	auto snap = getSnapshot();
+	std::string key(file.toLower().text());
+	const SShard& shard = *snap->shards[getShard(key)];
+	auto i = shard.fileIndex.find(key);
+	if (i == shard.fileIndex.end()) return CString();
+	return CString(i->second.name);
+}
 
-	for (std::map<CString, CString>::const_iterator i = fileList.begin(); i != fileList.end(); ++i)
-		if (i->first.comparei(file)) return CString(i->first);
-	return CString();
+void CFileSystem::setFile(const CString& name, const CString& path)
+{
+	// Caller must be inside beginUpdate()/endUpdate().
+	std::string key(name.toLower().text());
+	SShard& shard = changePendingShard(getShard(key));
+	auto res = shard.fileList.insert(std::make_pair(name, path));
+	if (!res.second)
+	{
+		res.first->second = path;
+		return;
+	}
+
+	auto i = shard.fileIndex.find(key);
+	if (i == shard.fileIndex.end())
+	{
+		shard.fileIndex[key] = { name, 1 };
+		return;
+	}
+
+	++i->second.count;
+	if (name < i->second.name)
+		i->second.name = name;
+}
+
+void CFileSystem::unsetFile(const CString& name)
+{
+	// Caller must be inside beginUpdate()/endUpdate().
+	// Only copy the shard if the file is in it.
+	std::string key(name.toLower().text());
+	unsigned int shardId = getShard(key);
+	const FileList& current = getPendingShard(shardId).fileList;
+	if (current.find(name) == current.end())
+		return;
+
+	SShard& shard = changePendingShard(shardId);
+	shard.fileList.erase(name);
+
+	auto i = shard.fileIndex.find(key);
+	if (i == shard.fileIndex.end())
+		return;
+
+	if (--i->second.count == 0)
+	{
+		shard.fileIndex.erase(i);
+		return;
+	}
+
+	// Another file only differs in case, so it is in the same shard.  If we
+	// were the one being returned, look for whichever of the others comes first now.
+	if (i->second.name != name)
+		return;
+	for (const auto& file : shard.fileList)
+	{
+		if (file.first.comparei(name))
+		{
+			i->second.name = file.first;
+			break;
+		}
+	}
 }
 
 #if (defined(_WIN32) || defined(_WIN64)) && !defined(__GNUC__)
@@ -170,7 +447,7 @@ void CFileSystem::loadAllDirectories(const CString& directory, bool recursive)
 			{
 				// Grab the file name.
 				CString file((char *)filedata.cFileName);
-				fileList[file] = CString(dir) << filedata.cFileName;
+				setFile(file, CString(dir) << filedata.cFileName);
 			}
 		} while (FindNextFileA(hFind, &filedata));
 	}
@@ -213,7 +490,7 @@ void CFileSystem::loadAllDirectories(const CString& directory, bool recursive)
 		// Grab the file name.
 		CString file(ent->d_name);
 		if (file.match(wildcard))
-			fileList[file] = CString(path) << file;
+			setFile(file, CString(path) << file);
 	}
 	closedir(dir);
 }
@@ -221,8 +498,6 @@ void CFileSystem::loadAllDirectories(const CString& directory, bool recursive)
 
 CString CFileSystem::load(const CString& file) const
 {
-	std::lock_guard<std::recursive_mutex> lock(*m_preventChange);
-
 	// Get the full path to the file.
 	CString fileName = find(file);
 	if (fileName.length() == 0) return CString();
@@ -236,8 +511,6 @@ CString CFileSystem::load(const CString& file) const
 
 time_t CFileSystem::getModTime(const CString& file) const
 {
-	std::lock_guard<std::recursive_mutex> lock(*m_preventChange);
-
 	// Get the full path to the file.
 	CString fileName = find(file);
 	if (fileName.length() == 0) return 0;
@@ -250,8 +523,6 @@ time_t CFileSystem::getModTime(const CString& file) const
 
 bool CFileSystem::setModTime(const CString& file, time_t modTime) const
 {
-	std::lock_guard<std::recursive_mutex> lock(*m_preventChange);
-
 	// Get the full path to the file.
 	CString fileName = find(file);
 	if (fileName.length() == 0) return false;
@@ -267,8 +538,6 @@ bool CFileSystem::setModTime(const CString& file, time_t modTime) const
 
 int CFileSystem::getFileSize(const CString& file) const
 {
-	std::lock_guard<std::recursive_mutex> lock(*m_preventChange);
-
 	// Get the full path to the file.
 	CString fileName = find(file);
 	if (fileName.length() == 0) return 0;
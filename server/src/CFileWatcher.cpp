@@ -0,0 +1,191 @@
+#include "IDebug.h"
+#include "CFileWatcher.h"
+#include "CFileSystem.h"
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#define FILEWATCHER_EVENTS	(IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+#endif
+
+CFileWatcher::CFileWatcher()
+	: inotifyFd(-1)
+{
+}
+
+CFileWatcher::~CFileWatcher()
+{
+	close();
+}
+
+#ifdef __linux__
+bool CFileWatcher::open()
+{
+	if (inotifyFd != -1)
+		return true;
+
+	inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	return (inotifyFd != -1);
+}
+
+void CFileWatcher::close()
+{
+	if (inotifyFd != -1)
+		::close(inotifyFd);
+	inotifyFd = -1;
+	watches.clear();
+	fileSystems.clear();
+}
+
+void CFileWatcher::clear()
+{
+	for (auto& watch : watches)
+		inotify_rm_watch(inotifyFd, watch.first);
+	watches.clear();
+	fileSystems.clear();
+}
+
+void CFileWatcher::watch(CFileSystem* pFileSystem)
+{
+	if (inotifyFd == -1)
+		return;
+
+	fileSystems.insert(pFileSystem);
+
+	// Directories are stored with their wildcard on the end.
+	for (const auto& entry : *pFileSystem->getDirList())
+	{
+		CString directory = entry.remove(entry.findl(CFileSystem::getPathSeparator()) + 1);
+		int wd = inotify_add_watch(inotifyFd, directory.text(), FILEWATCHER_EVENTS);
+		if (wd == -1)
+			continue;
+
+		// File systems share directories, and a directory can be listed more
+		// than once with different wildcards.  inotify gives us the same
+		// descriptor for all of them.
+		std::vector<SWatch>& list = watches[wd];
+		bool found = false;
+		for (const auto& watch : list)
+		{
+			if (watch.fileSystem == pFileSystem && watch.directory == directory)
+			{
+				found = true;
+				break;
+			}
+		}
+		if (!found)
+			list.push_back({ pFileSystem, directory });
+	}
+}
+
+bool CFileWatcher::onRecv()
+{
+	alignas(struct inotify_event) char buffer[16384];
+	std::set<CFileSystem*> needResync, updating;
+	bool overflow = false;
+
+	ssize_t len;
+	while ((len = read(inotifyFd, buffer, sizeof(buffer))) > 0)
+	{
+		for (char* ptr = buffer; ptr < buffer + len; )
+		{
+			const struct inotify_event* event = (const struct inotify_event*)ptr;
+			ptr += sizeof(struct inotify_event) + event->len;
+
+			// The kernel dropped events, we can't trust anything now.
+			if (event->mask & IN_Q_OVERFLOW)
+			{
+				overflow = true;
+				continue;
+			}
+
+			auto it = watches.find(event->wd);
+			if (it == watches.end())
+				continue;
+
+			// The directory itself went away.
+			if (event->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF))
+			{
+				for (const auto& watch : it->second)
+					needResync.insert(watch.fileSystem);
+				if (event->mask & IN_IGNORED)
+					watches.erase(it);
+				continue;
+			}
+
+			// New or removed sub directories change the directory list of
+			// recursive file systems.  Let a resync sort those out.
+			if (event->mask & IN_ISDIR)
+			{
+				for (const auto& watch : it->second)
+					needResync.insert(watch.fileSystem);
+				continue;
+			}
+
+			if (event->len == 0)
+				continue;
+
+			CString name(event->name);
+			for (const auto& watch : it->second)
+			{
+				// Publish everything from this read in one go.
+				if (updating.insert(watch.fileSystem).second)
+					watch.fileSystem->beginUpdate();
+
+				if (event->mask & (IN_CREATE | IN_MOVED_TO))
+					watch.fileSystem->fileAdded(watch.directory, name);
+				else if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+					watch.fileSystem->fileRemoved(watch.directory, name);
+			}
+		}
+	}
+
+	for (auto fs : updating)
+		fs->endUpdate();
+
+	if (overflow)
+		resync(fileSystems);
+	else if (!needResync.empty())
+		resync(needResync);
+
+	return true;
+}
+
+void CFileWatcher::resync(const std::set<CFileSystem*>& pFileSystems)
+{
+	// Copy it, pFileSystems may be our own list.
+	std::set<CFileSystem*> list(pFileSystems);
+	for (auto fs : list)
+	{
+		fs->resync();
+		watch(fs);
+	}
+}
+#else
+bool CFileWatcher::open()
+{
+	return false;
+}
+
+void CFileWatcher::close()
+{
+}
+
+void CFileWatcher::clear()
+{
+}
+
+void CFileWatcher::watch(CFileSystem* pFileSystem)
+{
+}
+
+bool CFileWatcher::onRecv()
+{
+	return true;
+}
+
+void CFileWatcher::resync(const std::set<CFileSystem*>& pFileSystems)
+{
+}
+#endif
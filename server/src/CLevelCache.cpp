@@ -0,0 +1,302 @@
+#include "IDebug.h"
+#include <string.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <stdint.h>
+#if defined(_WIN32) || defined(_WIN64)
+	#include <direct.h>
+	#define mkdir _mkdir
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <unistd.h>
+#endif
+
+#include "CLevelCache.h"
+
+// "GLVC", also tells us if the file was written with a different byte order.
+#define LEVELCACHE_MAGIC		0x43564C47
+
+namespace
+{
+	// Reads values out of a compiled level.  Running past the end of the file
+	// marks the whole read as failed instead of crashing.
+	class CLevelReader
+	{
+		public:
+			CLevelReader(const char* pData, size_t pLength)
+				: pos(pData), end(pData + pLength), failed(false)
+			{
+			}
+
+			bool isValid() const	{ return !failed; }
+
+			template <typename T>
+			T read()
+			{
+				T value = T();
+				if (failed || (size_t)(end - pos) < sizeof(T))
+				{
+					failed = true;
+					return value;
+				}
+				memcpy(&value, pos, sizeof(T));
+				pos += sizeof(T);
+				return value;
+			}
+
+			CString readString()
+			{
+				uint32_t len = read<uint32_t>();
+				CString value;
+				if (failed || (size_t)(end - pos) < len)
+				{
+					failed = true;
+					return value;
+				}
+				if (len != 0)
+					value.write(pos, (int)len);
+				pos += len;
+				return value;
+			}
+
+			// Counts are checked against what is left so a damaged file can't
+			// make us allocate a huge vector.
+			uint32_t readCount(size_t pMinSize)
+			{
+				uint32_t count = read<uint32_t>();
+				if (failed || (size_t)(end - pos) / pMinSize < count)
+				{
+					failed = true;
+					return 0;
+				}
+				return count;
+			}
+
+			void readBytes(void* pDest, size_t pLength)
+			{
+				if (failed || (size_t)(end - pos) < pLength)
+				{
+					failed = true;
+					return;
+				}
+				memcpy(pDest, pos, pLength);
+				pos += pLength;
+			}
+
+		private:
+			const char* pos;
+			const char* end;
+			bool failed;
+	};
+
+	template <typename T>
+	void writeValue(CString& pOut, T pValue)
+	{
+		pOut.write((const char*)&pValue, (int)sizeof(T));
+	}
+
+	void writeString(CString& pOut, const CString& pValue)
+	{
+		writeValue<uint32_t>(pOut, (uint32_t)pValue.length());
+		if (pValue.length() != 0)
+			pOut.write(pValue.text(), pValue.length());
+	}
+
+	bool parseLevel(CLevelReader& pReader, const CString& pSourceFile, const struct stat& pSourceStat, SLevelData& pData)
+	{
+		// Made from the same file as it is now?
+		if (pReader.read<uint32_t>() != LEVELCACHE_MAGIC || pReader.read<uint32_t>() != LEVELCACHE_VERSION)
+			return false;
+		if (pReader.read<int64_t>() != (int64_t)pSourceStat.st_mtime || pReader.read<int64_t>() != (int64_t)pSourceStat.st_size)
+			return false;
+		if (pReader.readString() != pSourceFile)
+			return false;
+
+		pData.fileVersion = pReader.readString();
+		pReader.readBytes(pData.tiles, sizeof(pData.tiles));
+
+		uint32_t count = pReader.readCount(sizeof(uint32_t));
+		pData.links.resize(count);
+		for (auto& link : pData.links)
+		{
+			uint32_t tokens = pReader.readCount(sizeof(uint32_t));
+			link.reserve(tokens);
+			for (uint32_t i = 0; i < tokens; ++i)
+				link.push_back(pReader.readString());
+		}
+
+		count = pReader.readCount(2 * sizeof(float) + 1 + sizeof(uint32_t));
+		pData.baddies.resize(count);
+		for (auto& baddy : pData.baddies)
+		{
+			baddy.x = pReader.read<float>();
+			baddy.y = pReader.read<float>();
+			baddy.type = pReader.read<char>();
+			baddy.props = pReader.readString();
+		}
+
+		count = pReader.readCount(2 * sizeof(uint32_t) + 2 * sizeof(float));
+		pData.npcs.resize(count);
+		for (auto& npc : pData.npcs)
+		{
+			npc.image = pReader.readString();
+			npc.code = pReader.readString();
+			npc.x = pReader.read<float>();
+			npc.y = pReader.read<float>();
+		}
+
+		count = pReader.readCount(4);
+		pData.chests.reserve(count);
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			char x = pReader.read<char>();
+			char y = pReader.read<char>();
+			char item = pReader.read<char>();
+			char sign = pReader.read<char>();
+			pData.chests.push_back(TLevelChest(x, y, item, sign));
+		}
+
+		count = pReader.readCount(2 * sizeof(int32_t) + 1 + sizeof(uint32_t));
+		pData.signs.resize(count);
+		for (auto& sign : pData.signs)
+		{
+			sign.x = pReader.read<int32_t>();
+			sign.y = pReader.read<int32_t>();
+			sign.encoded = (pReader.read<char>() != 0);
+			sign.text = pReader.readString();
+		}
+
+		// Ends with the magic again, so we know it wasn't cut short.
+		return (pReader.read<uint32_t>() == LEVELCACHE_MAGIC && pReader.isValid());
+	}
+}
+
+bool CLevelCache::load(const CString& pCacheFile, const CString& pSourceFile, SLevelData& pData)
+{
+	struct stat sourceStat;
+	if (stat(pSourceFile.text(), &sourceStat) != 0)
+		return false;
+
+	bool ret = false;
+	SLevelData data;
+
+#if defined(_WIN32) || defined(_WIN64)
+	CString fileData;
+	if (!fileData.load(pCacheFile) || fileData.length() == 0)
+		return false;
+
+	CLevelReader reader(fileData.text(), (size_t)fileData.length());
+	ret = parseLevel(reader, pSourceFile, sourceStat, data);
+#else
+	int fd = open(pCacheFile.text(), O_RDONLY);
+	if (fd == -1)
+		return false;
+
+	struct stat cacheStat;
+	if (fstat(fd, &cacheStat) == 0 && cacheStat.st_size > 0)
+	{
+		void* mapping = mmap(nullptr, (size_t)cacheStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (mapping != MAP_FAILED)
+		{
+			CLevelReader reader((const char*)mapping, (size_t)cacheStat.st_size);
+			ret = parseLevel(reader, pSourceFile, sourceStat, data);
+			munmap(mapping, (size_t)cacheStat.st_size);
+		}
+	}
+	close(fd);
+#endif
+
+	// Only hand it over once we know all of it is good.
+	if (ret)
+		pData = std::move(data);
+	return ret;
+}
+
+bool CLevelCache::save(const CString& pCacheFile, const CString& pSourceFile, const SLevelData& pData)
+{
+	struct stat sourceStat;
+	if (stat(pSourceFile.text(), &sourceStat) != 0)
+		return false;
+
+	CString out;
+	writeValue<uint32_t>(out, LEVELCACHE_MAGIC);
+	writeValue<uint32_t>(out, LEVELCACHE_VERSION);
+	writeValue<int64_t>(out, (int64_t)sourceStat.st_mtime);
+	writeValue<int64_t>(out, (int64_t)sourceStat.st_size);
+	writeString(out, pSourceFile);
+
+	writeString(out, pData.fileVersion);
+	out.write((const char*)pData.tiles, (int)sizeof(pData.tiles));
+
+	writeValue<uint32_t>(out, (uint32_t)pData.links.size());
+	for (const auto& link : pData.links)
+	{
+		writeValue<uint32_t>(out, (uint32_t)link.size());
+		for (const auto& token : link)
+			writeString(out, token);
+	}
+
+	writeValue<uint32_t>(out, (uint32_t)pData.baddies.size());
+	for (const auto& baddy : pData.baddies)
+	{
+		writeValue<float>(out, baddy.x);
+		writeValue<float>(out, baddy.y);
+		writeValue<char>(out, baddy.type);
+		writeString(out, baddy.props);
+	}
+
+	writeValue<uint32_t>(out, (uint32_t)pData.npcs.size());
+	for (const auto& npc : pData.npcs)
+	{
+		writeString(out, npc.image);
+		writeString(out, npc.code);
+		writeValue<float>(out, npc.x);
+		writeValue<float>(out, npc.y);
+	}
+
+	writeValue<uint32_t>(out, (uint32_t)pData.chests.size());
+	for (const auto& chest : pData.chests)
+	{
+		writeValue<char>(out, (char)chest.getX());
+		writeValue<char>(out, (char)chest.getY());
+		writeValue<char>(out, (char)chest.getItemIndex());
+		writeValue<char>(out, (char)chest.getSignIndex());
+	}
+
+	writeValue<uint32_t>(out, (uint32_t)pData.signs.size());
+	for (const auto& sign : pData.signs)
+	{
+		writeValue<int32_t>(out, (int32_t)sign.x);
+		writeValue<int32_t>(out, (int32_t)sign.y);
+		writeValue<char>(out, (char)(sign.encoded ? 1 : 0));
+		writeString(out, sign.text);
+	}
+
+	writeValue<uint32_t>(out, LEVELCACHE_MAGIC);
+
+	// Make sure the directory exists.
+	int sep = pCacheFile.findl('/');
+	if (sep != -1)
+	{
+#if defined(_WIN32) || defined(_WIN64)
+		mkdir(pCacheFile.subString(0, sep).text());
+#else
+		mkdir(pCacheFile.subString(0, sep).text(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
+#endif
+	}
+
+	// Write it somewhere else first so nobody maps a half written file.
+	CString tempFile = CString() << pCacheFile << ".tmp";
+	if (!out.save(tempFile))
+		return false;
+#if defined(_WIN32) || defined(_WIN64)
+	remove(pCacheFile.text());
+#endif
+	if (rename(tempFile.text(), pCacheFile.text()) != 0)
+	{
+		remove(tempFile.text());
+		return false;
+	}
+	return true;
+}
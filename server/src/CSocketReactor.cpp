@@ -0,0 +1,416 @@
+#include "IDebug.h"
+#include <vector>
+
+#include "CSocketReactor.h"
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <errno.h>
+
+// Max events collected per epoll_wait call.
+#define REACTOR_MAX_EVENTS	256
+
+CSocketReactor::CSocketReactor()
+	: epollFd(-1), timerFd(-1), wakeFd(-1), tickInterval(50)
+{
+}
+
+CSocketReactor::~CSocketReactor()
+{
+	close();
+}
+
+bool CSocketReactor::open()
+{
+	if (epollFd != -1)
+		return true;
+
+	epollFd = epoll_create1(EPOLL_CLOEXEC);
+	if (epollFd == -1)
+		return false;
+
+	timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (timerFd != -1)
+	{
+		epoll_event ev = {};
+		ev.events = EPOLLIN;
+		ev.data.ptr = nullptr;
+		epoll_ctl(epollFd, EPOLL_CTL_ADD, timerFd, &ev);
+	}
+
+	// Other threads use this to get our attention.
+	wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (wakeFd != -1)
+	{
+		epoll_event ev = {};
+		ev.events = EPOLLIN;
+		ev.data.ptr = this;
+		epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &ev);
+	}
+
+	setTickInterval(tickInterval);
+	return true;
+}
+
+void CSocketReactor::close()
+{
+	if (wakeFd != -1)
+		::close(wakeFd);
+	if (timerFd != -1)
+		::close(timerFd);
+	if (epollFd != -1)
+		::close(epollFd);
+	wakeFd = timerFd = epollFd = -1;
+	stubs.clear();
+}
+
+void CSocketReactor::setTickInterval(const std::chrono::milliseconds& interval)
+{
+	tickInterval = interval;
+	if (timerFd == -1)
+		return;
+
+	itimerspec spec = {};
+	spec.it_interval.tv_sec = (time_t)(interval.count() / 1000);
+	spec.it_interval.tv_nsec = (long)(interval.count() % 1000) * 1000000;
+	spec.it_value = spec.it_interval;
+	timerfd_settime(timerFd, 0, &spec, nullptr);
+}
+
+void CSocketReactor::wakeup()
+{
+	if (wakeFd == -1)
+		return;
+
+	uint64_t value = 1;
+	if (write(wakeFd, &value, sizeof(value)) < 0)
+		return;
+}
+
+void CSocketReactor::markDirty(CSocketStub* stub)
+{
+	std::lock_guard<std::mutex> lock(dirtyLock);
+	dirty.insert(stub);
+}
+
+bool CSocketReactor::registerSocket(CSocketStub* stub)
+{
+	if (stub == nullptr || !open())
+		return false;
+
+	// Re-registering (the serverlist does this on reconnect) replaces the old handle.
+	if (stubs.find(stub) != stubs.end())
+		removeStub(stub, false);
+
+	SOCKET handle = stub->getSocketHandle();
+	if (handle == INVALID_SOCKET)
+		return false;
+
+	// Listening sockets stay level-triggered since we accept one client per event.
+	// Connected sockets are edge-triggered and drained in dispatch().
+	int acceptConn = 0;
+	socklen_t len = sizeof(acceptConn);
+	bool isListener = (getsockopt(handle, SOL_SOCKET, SO_ACCEPTCONN, &acceptConn, &len) == 0 && acceptConn != 0);
+
+	epoll_event ev = {};
+	ev.events = EPOLLIN | EPOLLRDHUP | (isListener ? 0 : EPOLLET);
+	ev.data.ptr = stub;
+	if (epoll_ctl(epollFd, EPOLL_CTL_ADD, handle, &ev) != 0)
+		return false;
+
+	stubs[stub] = { handle, isListener, false };
+
+	// Anything queued before we knew about it.
+	markDirty(stub);
+	return stub->onRegister();
+}
+
+bool CSocketReactor::unregisterSocket(CSocketStub* stub)
+{
+	if (stubs.find(stub) == stubs.end())
+		return false;
+
+	removeStub(stub, false);
+	return true;
+}
+
+void CSocketReactor::removeStub(CSocketStub* stub, bool callOnUnregister)
+{
+	auto it = stubs.find(stub);
+	if (it == stubs.end())
+		return;
+
+	// The handle may already be closed, in which case the kernel dropped it for us.
+	epoll_ctl(epollFd, EPOLL_CTL_DEL, it->second.handle, nullptr);
+	stubs.erase(it);
+	{
+		std::lock_guard<std::mutex> lock(dirtyLock);
+		dirty.erase(stub);
+	}
+
+	if (callOnUnregister)
+		stub->onUnregister();
+}
+
+void CSocketReactor::cleanup(bool callOnUnregister)
+{
+	if (callOnUnregister)
+	{
+		std::vector<CSocketStub*> list;
+		list.reserve(stubs.size());
+		for (auto& entry : stubs)
+			list.push_back(entry.first);
+		for (auto stub : list)
+			stub->onUnregister();
+	}
+
+	// The sockets have already been closed by the owners, so just drop the epoll set.
+	close();
+}
+
+void CSocketReactor::updateInterest(CSocketStub* stub, bool wantWrite)
+{
+	auto it = stubs.find(stub);
+	if (it == stubs.end() || it->second.writeArmed == wantWrite)
+		return;
+
+	epoll_event ev = {};
+	ev.events = EPOLLIN | EPOLLRDHUP | (it->second.isListener ? 0 : EPOLLET) | (wantWrite ? EPOLLOUT : 0);
+	ev.data.ptr = stub;
+	if (epoll_ctl(epollFd, EPOLL_CTL_MOD, it->second.handle, &ev) == 0)
+		it->second.writeArmed = wantWrite;
+}
+
+bool CSocketReactor::updateSingle(CSocketStub* stub, bool pRecv, bool pSend)
+{
+	if (stubs.find(stub) == stubs.end())
+		return false;
+
+	if (pRecv && stub->canRecv())
+	{
+		if (!stub->onRecv())
+		{
+			removeStub(stub, true);
+			return false;
+		}
+	}
+
+	if (pSend && stub->canSend())
+	{
+		if (!stub->onSend())
+		{
+			removeStub(stub, true);
+			return false;
+		}
+	}
+
+	// Anything the socket would not take yet is sent when epoll says it is writable.
+	if (stubs.find(stub) != stubs.end())
+		updateInterest(stub, stub->canSend());
+	return true;
+}
+
+void CSocketReactor::dispatch(CSocketStub* stub, unsigned int events)
+{
+	auto it = stubs.find(stub);
+	if (it == stubs.end())
+		return;
+
+	if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+	{
+		SOCKET handle = it->second.handle;
+		bool edgeTriggered = !it->second.isListener;
+
+		// onRecv() reads one chunk at a time, so keep going while the kernel
+		// still has data buffered or we won't hear about it again.
+		int pending;
+		do
+		{
+			if (!stub->canRecv())
+				break;
+
+			if (!stub->onRecv())
+			{
+				removeStub(stub, true);
+				return;
+			}
+
+			// onRecv() may have unregistered the socket itself.
+			if (stubs.find(stub) == stubs.end())
+				return;
+
+			pending = 0;
+			if (!edgeTriggered || ioctl(handle, FIONREAD, &pending) != 0)
+				break;
+		} while (pending > 0);
+	}
+
+	// Writes wait for flushPending() at the end of the tick, so everything
+	// queued for a socket during the tick goes out in one frame.
+	if (events & EPOLLOUT)
+		markDirty(stub);
+}
+
+void CSocketReactor::flushPending()
+{
+	// Packets can be queued from anywhere (timers, scripts, other players) so
+	// give every socket with outgoing data a chance to write before sleeping.
+	// This is the only place players are flushed, once per main loop iteration.
+	// Only the sockets that queued something, became writable, or still had
+	// data left last time are looked at, so idle connections cost nothing.
+	std::vector<CSocketStub*> list;
+	{
+		std::lock_guard<std::mutex> lock(dirtyLock);
+		list.assign(dirty.begin(), dirty.end());
+		dirty.clear();
+	}
+
+	for (auto stub : list)
+	{
+		if (stubs.find(stub) == stubs.end())
+			continue;
+
+		bool wantWrite = stub->canSend();
+		if (wantWrite)
+		{
+			if (!stub->onSend())
+			{
+				removeStub(stub, true);
+				continue;
+			}
+			wantWrite = stub->canSend();
+
+			// Still something left, look at it again next time.
+			if (wantWrite)
+				markDirty(stub);
+		}
+		updateInterest(stub, wantWrite);
+	}
+}
+
+bool CSocketReactor::update(int timeoutMs)
+{
+	if (!open())
+		return false;
+
+	// Send whatever was queued since the last wait.
+	flushPending();
+
+	// Without a timer we can't sleep forever.
+	if (timerFd == -1 && (timeoutMs < 0 || timeoutMs > tickInterval.count()))
+		timeoutMs = (int)tickInterval.count();
+
+	epoll_event events[REACTOR_MAX_EVENTS];
+	int count = epoll_wait(epollFd, events, REACTOR_MAX_EVENTS, timeoutMs);
+	if (count < 0)
+		return (errno == EINTR);
+
+	for (int i = 0; i < count; ++i)
+	{
+		CSocketStub* stub = (CSocketStub*)events[i].data.ptr;
+		if (stub == nullptr)
+		{
+			// Tick timer.
+			uint64_t expirations;
+			while (read(timerFd, &expirations, sizeof(expirations)) > 0);
+			continue;
+		}
+
+		if (events[i].data.ptr == this)
+		{
+			// Woken up by another thread.
+			uint64_t wakeups;
+			while (read(wakeFd, &wakeups, sizeof(wakeups)) > 0);
+			continue;
+		}
+
+		dispatch(stub, events[i].events);
+	}
+
+	return true;
+}
+
+#else
+
+CSocketReactor::CSocketReactor()
+	: tickInterval(50)
+{
+}
+
+CSocketReactor::~CSocketReactor()
+{
+}
+
+void CSocketReactor::setTickInterval(const std::chrono::milliseconds& interval)
+{
+	tickInterval = interval;
+}
+
+void CSocketReactor::wakeup()
+{
+	// update() never waits more than 5ms here anyway.
+}
+
+void CSocketReactor::markDirty(CSocketStub* stub)
+{
+	// CSocketManager looks at every socket on each update.
+}
+
+bool CSocketReactor::registerSocket(CSocketStub* stub)
+{
+	return sockManager.registerSocket(stub);
+}
+
+bool CSocketReactor::unregisterSocket(CSocketStub* stub)
+{
+	return sockManager.unregisterSocket(stub);
+}
+
+bool CSocketReactor::updateSingle(CSocketStub* stub, bool pRecv, bool pSend)
+{
+	return sockManager.updateSingle(stub, pRecv, pSend);
+}
+
+void CSocketReactor::cleanup(bool callOnUnregister)
+{
+	sockManager.cleanup(callOnUnregister);
+}
+
+bool CSocketReactor::update(int timeoutMs)
+{
+	// select() based fallback, keep the old 5ms poll.
+	if (timeoutMs < 0 || timeoutMs > 5)
+		timeoutMs = 5;
+	return sockManager.update(0, timeoutMs * 1000);
+}
+
+#endif
+
+static thread_local std::atomic<unsigned long long>* sendCounter = nullptr;
+
+CSendCounter::CSendCounter(std::atomic<unsigned long long>* pCounter)
+	: previous(sendCounter)
+{
+	sendCounter = pCounter;
+}
+
+CSendCounter::~CSendCounter()
+{
+	sendCounter = previous;
+}
+
+#ifdef WRAP_SEND
+extern "C" ssize_t __real_send(int sockfd, const void* buf, size_t len, int flags);
+
+extern "C" ssize_t __wrap_send(int sockfd, const void* buf, size_t len, int flags)
+{
+	if (sendCounter != nullptr)
+		++*sendCounter;
+	return __real_send(sockfd, buf, len, flags);
+}
+#endif
@@ -0,0 +1,103 @@
+#include "CTimerWheel.h"
+
+CTimerWheel::CTimerWheel()
+	: current(getTimerSeconds())
+{
+}
+
+void CTimerWheel::add(TLevel* pLevel, long long pDue)
+{
+	insert({ pLevel, pDue });
+}
+
+void CTimerWheel::remove(TLevel* pLevel, long long pDue)
+{
+	// A timer can only be in one of these, depending on how far away it was when inserted.
+	if (removeFrom(ready, pLevel, pDue)) return;
+	if (removeFrom(inner[pDue % TIMERWHEEL_INNER], pLevel, pDue)) return;
+	if (removeFrom(outer[(pDue / TIMERWHEEL_INNER) % TIMERWHEEL_OUTER], pLevel, pDue)) return;
+	removeFrom(overflow, pLevel, pDue);
+}
+
+void CTimerWheel::clear()
+{
+	for (auto& slot : inner) slot.clear();
+	for (auto& slot : outer) slot.clear();
+	overflow.clear();
+	ready.clear();
+}
+
+void CTimerWheel::advance(long long pNow, std::vector<TLevel*>& pExpired)
+{
+	// If we fell more than a full turn of the outer wheel behind, don't walk it
+	// second by second.  Just pull everything out and put back what isn't due.
+	if (pNow - current > (long long)TIMERWHEEL_INNER * TIMERWHEEL_OUTER)
+	{
+		std::vector<STimer> timers;
+		timers.swap(ready);
+		for (auto& slot : inner) { timers.insert(timers.end(), slot.begin(), slot.end()); slot.clear(); }
+		for (auto& slot : outer) { timers.insert(timers.end(), slot.begin(), slot.end()); slot.clear(); }
+		timers.insert(timers.end(), overflow.begin(), overflow.end());
+		overflow.clear();
+
+		current = pNow;
+		for (const auto& timer : timers)
+			insert(timer);
+	}
+
+	while (current < pNow)
+	{
+		++current;
+
+		// Start of a new inner turn, bring the next block of timers in from the outer wheel.
+		if (current % TIMERWHEEL_INNER == 0)
+			cascade();
+
+		std::vector<STimer>& slot = inner[current % TIMERWHEEL_INNER];
+		ready.insert(ready.end(), slot.begin(), slot.end());
+		slot.clear();
+	}
+
+	for (const auto& timer : ready)
+		pExpired.push_back(timer.level);
+	ready.clear();
+}
+
+void CTimerWheel::insert(const STimer& pTimer)
+{
+	long long delta = pTimer.due - current;
+	if (delta <= 0)
+		ready.push_back(pTimer);
+	else if (delta < TIMERWHEEL_INNER)
+		inner[pTimer.due % TIMERWHEEL_INNER].push_back(pTimer);
+	else if (delta < (long long)TIMERWHEEL_INNER * TIMERWHEEL_OUTER)
+		outer[(pTimer.due / TIMERWHEEL_INNER) % TIMERWHEEL_OUTER].push_back(pTimer);
+	else
+		overflow.push_back(pTimer);
+}
+
+void CTimerWheel::cascade()
+{
+	std::vector<STimer> timers;
+	timers.swap(outer[(current / TIMERWHEEL_INNER) % TIMERWHEEL_OUTER]);
+
+	// The overflow list is rarely used, so just recheck it every turn.
+	timers.insert(timers.end(), overflow.begin(), overflow.end());
+	overflow.clear();
+
+	for (const auto& timer : timers)
+		insert(timer);
+}
+
+bool CTimerWheel::removeFrom(std::vector<STimer>& pList, TLevel* pLevel, long long pDue)
+{
+	for (auto it = pList.begin(); it != pList.end(); ++it)
+	{
+		if (it->level == pLevel && it->due == pDue)
+		{
+			pList.erase(it);
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,139 @@
+#include "IDebug.h"
+#include "CWorkerPool.h"
+
+CWorkerPool::CWorkerPool()
+	: stopping(false)
+{
+}
+
+CWorkerPool::~CWorkerPool()
+{
+	stop();
+}
+
+void CWorkerPool::start(unsigned int pThreads)
+{
+	stop();
+
+	stopping = false;
+	for (unsigned int i = 0; i < pThreads; ++i)
+		threads.emplace_back(&CWorkerPool::run, this);
+}
+
+void CWorkerPool::stop()
+{
+	if (threads.empty())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		stopping = true;
+	}
+	m_jobReady.notify_all();
+
+	for (auto& thread : threads)
+		thread.join();
+	threads.clear();
+
+	// Anything left over was cancelled by the shutdown.
+	strands.clear();
+	readyKeys.clear();
+}
+
+void CWorkerPool::queue(const void* pKey, std::function<void()> pJob)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		SStrand& strand = strands[pKey];
+		strand.jobs.push_back(std::move(pJob));
+
+		// A strand that is already waiting or running picks the job up itself.
+		if (strand.active || strand.jobs.size() > 1)
+			return;
+		readyKeys.push_back(pKey);
+	}
+	m_jobReady.notify_one();
+}
+
+void CWorkerPool::cancel(const void* pKey)
+{
+	std::unique_lock<std::mutex> lock(m_lock);
+	auto it = strands.find(pKey);
+	if (it == strands.end())
+		return;
+
+	it->second.jobs.clear();
+	m_jobDone.wait(lock, [this, pKey]() {
+		auto it = strands.find(pKey);
+		return (it == strands.end() || !it->second.active);
+	});
+
+	strands.erase(pKey);
+	for (auto i = readyKeys.begin(); i != readyKeys.end(); )
+	{
+		if (*i == pKey)
+			i = readyKeys.erase(i);
+		else ++i;
+	}
+}
+
+void CWorkerPool::wait(const void* pKey)
+{
+	std::unique_lock<std::mutex> lock(m_lock);
+	m_jobDone.wait(lock, [this, pKey]() { return strands.find(pKey) == strands.end(); });
+}
+
+void CWorkerPool::runAll(std::vector<std::function<void()> >& pJobs)
+{
+	if (threads.empty())
+	{
+		for (auto& job : pJobs)
+			job();
+		return;
+	}
+
+	// Each job gets its own key so they can all run at once.
+	for (auto& job : pJobs)
+		queue(&job, job);
+	for (auto& job : pJobs)
+		wait(&job);
+}
+
+void CWorkerPool::run()
+{
+	std::unique_lock<std::mutex> lock(m_lock);
+	while (true)
+	{
+		m_jobReady.wait(lock, [this]() { return stopping || !readyKeys.empty(); });
+		if (stopping)
+			return;
+
+		const void* key = readyKeys.front();
+		readyKeys.pop_front();
+
+		auto it = strands.find(key);
+		if (it == strands.end() || it->second.jobs.empty())
+			continue;
+
+		SStrand& strand = it->second;
+		std::function<void()> job = std::move(strand.jobs.front());
+		strand.jobs.pop_front();
+		strand.active = true;
+
+		lock.unlock();
+		job();
+		lock.lock();
+
+		// The strand can't have been erased while active, cancel() waits for us.
+		SStrand& done = strands[key];
+		done.active = false;
+		if (!done.jobs.empty())
+		{
+			readyKeys.push_back(key);
+			m_jobReady.notify_one();
+		}
+		else strands.erase(key);
+
+		m_jobDone.notify_all();
+	}
+}
@@ -53,25 +53,36 @@ void TAccount::reset()
 
 bool TAccount::loadAccount(const CString& pAccount, bool ignoreNickname)
 {
-	// Just in case this account was loaded offline through RC.
-	accountName = pAccount;
-
 	bool loadedFromDefault = false;
-	CFileSystem* accfs = server->getAccountsFileSystem();
 	std::vector<CString> fileData;
 
+	readAccountFile(server, pAccount, fileData, loadedFromDefault);
+	return parseAccount(pAccount, fileData, loadedFromDefault, ignoreNickname);
+}
+
+void TAccount::readAccountFile(TServer* pServer, const CString& pAccount, std::vector<CString>& pFileData, bool& pLoadedFromDefault)
+{
 	// Find the account in the file system.
-	CString accpath(accfs->findi(CString() << pAccount << ".txt"));
+	CString accpath(pServer->getAccountsFileSystem()->findi(CString() << pAccount << ".txt"));
+	pLoadedFromDefault = false;
 	if (accpath.length() == 0)
 	{
-		accpath = CString() << server->getServerPath() << "accounts/defaultaccount.txt";
+		accpath = CString() << pServer->getServerPath() << "accounts/defaultaccount.txt";
 		CFileSystem::fixPathSeparators(accpath);
-		loadedFromDefault = true;
+		pLoadedFromDefault = true;
 	}
 
 	// Load file.
-	fileData = CString::loadToken(accpath, "\n");
-	if (fileData.empty() || fileData[0].trim() != "GRACC001")
+	pFileData = CString::loadToken(accpath, "\n");
+}
+
+bool TAccount::parseAccount(const CString& pAccount, std::vector<CString>& pFileData, bool pLoadedFromDefault, bool ignoreNickname)
+{
+	// Just in case this account was loaded offline through RC.
+	accountName = pAccount;
+
+	CFileSystem* accfs = server->getAccountsFileSystem();
+	if (pFileData.empty() || pFileData[0].trim() != "GRACC001")
 		return false;
 
 	// Clear Lists
@@ -83,7 +94,7 @@ bool TAccount::loadAccount(const CString& pAccount, bool ignoreNickname)
 	PMServerList.clear();
 
 	// Parse File
-	for (auto & i : fileData)
+	for (auto & i : pFileData)
 	{
 		// Trim Line
 		i.trimI();
@@ -210,7 +221,7 @@ bool TAccount::loadAccount(const CString& pAccount, bool ignoreNickname)
 		communityName = accountName;
 
 	// If we loaded from the default account...
-	if (loadedFromDefault)
+	if (pLoadedFromDefault)
 	{
 		CSettings* settings = server->getSettings();
 
@@ -1,4 +1,6 @@
 #include <set>
+#include <algorithm>
+#include <unordered_set>
 #include <tiletypes.h>
 #include <cmath>
 #include "IDebug.h"
@@ -7,6 +9,7 @@
 #include "TLevel.h"
 #include "TPlayer.h"
 #include "TNPC.h"
+#include "TMap.h"
 
 /*
 	Global Variables
@@ -23,19 +26,22 @@ short respawningTiles[] = {
 */
 TLevel::TLevel(TServer* pServer)
 :
-server(pServer), modTime(0), levelSpar(false), levelSingleplayer(false)
+server(pServer), modTime(0), levelSpar(false), levelSingleplayer(false),
+levelTemplate(emptyTemplate()), levelMap(nullptr), mapX(0), mapY(0), mapVersion(0), timedEventDue(-1), signsTranslationVersion(0)
 #ifdef V8NPCSERVER
 , _scriptObject(nullptr)
 #endif
 {
-	memset(levelTiles, 0, sizeof(levelTiles));
-
 	// Baddy id 0 breaks the client.  Put a null pointer in id 0.
 	levelBaddyIds.resize(1, 0);
 }
 
 TLevel::~TLevel()
 {
+	// Stop the server from running our timed events.
+	if (timedEventDue >= 0)
+		server->getLevelTimers()->remove(this, timedEventDue);
+
 	// Delete NPCs.
 	{
 		// Remove every NPC in the level.
@@ -45,6 +51,10 @@ TLevel::~TLevel()
 				server->deleteNPC(levelNPC, false);
 		}
 		levelNPCs.clear();
+#ifdef V8NPCSERVER
+		npcGrid.clear();
+		npcGridAreas.clear();
+#endif
 	}
 
 	// Delete baddies.
@@ -52,15 +62,6 @@ TLevel::~TLevel()
 	levelBaddies.clear();
 	levelBaddyIds.clear();
 
-	// Delete chests.
-	levelChests.clear();
-
-	// Delete links.
-	levelLinks.clear();
-
-	// Delete signs.
-	levelSigns.clear();
-
 	// Delete items.
 	for (auto& item : levelItems)
 	{
@@ -87,9 +88,12 @@ TLevel::~TLevel()
 /*
 	TLevel: Get Crafted Packets
 */
-CString TLevel::getBaddyPacket(int clientVersion)
+const CString& TLevel::getBaddyPacket(int clientVersion)
 {
-	CString retVal;
+	CString& retVal = baddyPackets[clientVersion];
+	if (!retVal.isEmpty() || levelBaddies.empty())
+		return retVal;
+
 	for (const auto& baddy : levelBaddies)
 	{
 		assert(baddy != nullptr);
@@ -102,13 +106,9 @@ CString TLevel::getBaddyPacket(int clientVersion)
 	return retVal;
 }
 
-CString TLevel::getBoardPacket()
+const CString& TLevel::getBoardPacket()
 {
-	CString retVal;
-	retVal.writeGChar(PLO_BOARDPACKET);
-	retVal.write((char *)levelTiles, sizeof(levelTiles));
-	retVal << "\n";
-	return retVal;
+	return levelTemplate->boardPacket;
 }
 
 CString TLevel::getBoardChangesPacket(time_t time)
@@ -141,7 +141,7 @@ CString TLevel::getChestPacket(TPlayer *pPlayer)
 
 	if (pPlayer)
 	{
-		for (auto& chest : levelChests)
+		for (auto& chest : levelTemplate->data.chests)
 		{
 			bool hasChest = pPlayer->hasChest(getChestStr(chest));
 
@@ -154,26 +154,22 @@ CString TLevel::getChestPacket(TPlayer *pPlayer)
 	return retVal;
 }
 
-CString TLevel::getHorsePacket()
+const CString& TLevel::getHorsePacket()
 {
-	CString retVal;
-	for (auto& horse : levelHorses)
+	if (horsePacket.isEmpty())
 	{
-		retVal >> (char)PLO_HORSEADD << horse.getHorseStr() << "\n";
+		for (auto& horse : levelHorses)
+		{
+			horsePacket >> (char)PLO_HORSEADD << horse.getHorseStr() << "\n";
+		}
 	}
 
-	return retVal;
+	return horsePacket;
 }
 
-CString TLevel::getLinksPacket()
+const CString& TLevel::getLinksPacket()
 {
-	CString retVal;
-	for (const auto& link : levelLinks)
-	{
-		retVal >> (char)PLO_LEVELLINK << link.getLinkStr() << "\n";
-	}
-
-	return retVal;
+	return levelTemplate->linksPacket;
 }
 
 CString TLevel::getNpcsPacket(time_t time, int clientVersion)
@@ -186,14 +182,36 @@ CString TLevel::getNpcsPacket(time_t time, int clientVersion)
 	return retVal;
 }
 
-CString TLevel::getSignsPacket(TPlayer *pPlayer = 0)
+const CString& TLevel::getSignsPacket(TPlayer *pPlayer = 0)
 {
-	CString retVal;
-	for (const auto & sign : levelSigns)
+	// Signs are translated into the player's language.
+	CString* retVal = &signsPacket;
+	if (pPlayer)
+	{
+		if (signsTranslationVersion != server->getTranslationVersion())
+		{
+			signsPacketsByLang.clear();
+			signsTranslationVersion = server->getTranslationVersion();
+		}
+		retVal = &signsPacketsByLang[pPlayer->getLanguage().toLower().text()];
+	}
+
+	if (retVal->isEmpty())
 	{
-		retVal >> (char)PLO_LEVELSIGN << sign.getSignStr(pPlayer) << "\n";
+		for (const auto & sign : levelTemplate->signs)
+		{
+			*retVal >> (char)PLO_LEVELSIGN << sign.getSignStr(pPlayer) << "\n";
+		}
 	}
-	return retVal;
+	return *retVal;
+}
+
+void TLevel::invalidatePacketCache()
+{
+	horsePacket.clear();
+	signsPacket.clear();
+	baddyPackets.clear();
+	signsPacketsByLang.clear();
 }
 
 /*
@@ -211,6 +229,9 @@ bool TLevel::reload()
 			TNPC *npc = *it;
 			if (npc->isLevelNPC())
 			{
+#ifdef V8NPCSERVER
+				removeNPCFromGrid(npc);
+#endif
 				server->deleteNPC(npc, false);
 				it = levelNPCs.erase(it);
 			}
@@ -229,15 +250,6 @@ bool TLevel::reload()
 	levelBaddies.clear();
 	levelBaddyIds.clear();
 
-	// Delete chests.
-	levelChests.clear();
-
-	// Delete links.
-	levelLinks.clear();
-
-	// Delete signs.
-	levelSigns.clear();
-
 	// Delete items.
 	for (auto& item : levelItems)
 	{
@@ -286,479 +298,397 @@ bool TLevel::reload()
 
 TLevel* TLevel::clone()
 {
+	// Share what never changes instead of loading the level again.
 	TLevel *level = new TLevel(server);
-	if (!level->loadLevel(levelName))
-	{
-		delete level;
-		return nullptr;
-	}
+	level->actualLevelName = level->levelName = levelName;
+	level->fileName = fileName;
+	level->fileVersion = fileVersion;
+	level->modTime = modTime;
+	level->setTemplate(levelTemplate);
 	return level;
 }
 
 bool TLevel::loadLevel(const CString& pLevelName)
+{
+	// Get the appropriate filesystem.
+	CFileSystem* fileSystem = server->getFileSystem();
+	if (!server->getSettings()->getBool("nofoldersconfig", false))
+		fileSystem = server->getFileSystem(FS_LEVEL);
+
+	// Path-To-File
+	actualLevelName = levelName = pLevelName;
+	fileName = fileSystem->find(pLevelName);
+	modTime = fileSystem->getModTime(pLevelName);
+
+	// Read the level, then build it.
+	SLevelData data;
+	bool ret = readLevel(data);
+	fileVersion = data.fileVersion;
+	setTemplate(ret ? buildTemplate(data, fileSystem) : emptyTemplate());
+	return ret;
+}
+
+void TLevel::setTemplate(const std::shared_ptr<const SLevelTemplate>& pTemplate)
 {
 #ifdef V8NPCSERVER
 	server->getScriptEngine()->WrapObject(this);
 #endif
 
-	CString ext(getExtension(pLevelName));
-	if (ext == ".nw") return loadNW(pLevelName);
-	else if (ext == ".graal") return loadGraal(pLevelName);
-	else if (ext == ".zelda") return loadZelda(pLevelName);
-	else return detectLevelType(pLevelName);
+	// Everything we send about the level is about to change.
+	invalidatePacketCache();
+	levelTemplate = pTemplate;
+
+	// Baddies and NPCs move around, so every level gets its own.
+	for (const auto& levelBaddy : levelTemplate->data.baddies)
+	{
+		TLevelBaddy* baddy = addBaddy(levelBaddy.x, levelBaddy.y, levelBaddy.type);
+		if (baddy != nullptr && levelBaddy.props.length() != 0)
+			baddy->setProps(levelBaddy.props);
+	}
+
+	for (const auto& levelNPC : levelTemplate->data.npcs)
+	{
+		TNPC* npc = server->addNPC(levelNPC.image, levelNPC.code, levelNPC.x, levelNPC.y, this, true, false);
+		addNPC(npc);
+	}
+
+	// Look up our map position now that we have our name.
+	mapVersion = 0;
+	cacheMap();
 }
 
-bool TLevel::detectLevelType(const CString& pLevelName)
+std::shared_ptr<const TLevel::SLevelTemplate> TLevel::buildTemplate(SLevelData& pData, CFileSystem* fileSystem)
 {
-	// Get the appropriate filesystem.
-	CFileSystem* fileSystem = server->getFileSystem();
-	if (!server->getSettings()->getBool("nofoldersconfig", false))
-		fileSystem = server->getFileSystem(FS_LEVEL);
+	auto newTemplate = std::make_shared<SLevelTemplate>();
 
-	// Load file
-	CString fileData;
-	if (!fileData.load(fileSystem->find(pLevelName)))
-		return false;
+	// Only keep links to levels we have.
+	for (const auto& link : pData.links)
+	{
+		CString level(link[0]);
+		if (link.size() > 7)
+		{
+			for (size_t i = 0; i < link.size() - 7; ++i)
+				level << " " << link[i + 1];
+		}
 
-	// Grab file version.
-	fileVersion = fileData.readChars(8);
+		if (fileSystem->find(level).isEmpty())
+			continue;
 
-	// Determine the level type.
-	int v = -1;
-	if (fileVersion == "GLEVNW01") v = 0;
-	else if (fileVersion == "GR-V1.03" || fileVersion == "GR-V1.02" || fileVersion == "GR-V1.01") v = 1;
-	else if (fileVersion == "Z3-V1.04" || fileVersion == "Z3-V1.03") v = 2;
+		newTemplate->links.emplace_back(link);
+	}
 
-	// Not a level.
-	if (v == -1) return false;
+	for (const auto& sign : pData.signs)
+		newTemplate->signs.push_back(TLevelSign(sign.x, sign.y, sign.text, sign.encoded));
+
+	// Every player entering the level is sent these.
+	newTemplate->boardPacket.writeGChar(PLO_BOARDPACKET);
+	newTemplate->boardPacket.write((char *)pData.tiles, sizeof(pData.tiles));
+	newTemplate->boardPacket << "\n";
+	for (const auto& link : newTemplate->links)
+		newTemplate->linksPacket >> (char)PLO_LEVELLINK << link.getLinkStr() << "\n";
+
+	// The links and signs were turned into objects above, don't keep them twice.
+	pData.links.clear();
+	pData.signs.clear();
+	newTemplate->data = std::move(pData);
+	return newTemplate;
+}
 
-	// Load the correct level.
-	if (v == 0) return loadNW(pLevelName);
-	if (v == 1) return loadGraal(pLevelName);
-	if (v == 2) return loadZelda(pLevelName);
-	return false;
+std::shared_ptr<const TLevel::SLevelTemplate> TLevel::emptyTemplate()
+{
+	static std::shared_ptr<const SLevelTemplate> empty = std::make_shared<SLevelTemplate>();
+	return empty;
 }
 
-bool TLevel::loadZelda(const CString& pLevelName)
+bool TLevel::readLevel(SLevelData& pData)
 {
-	// Get the appropriate filesystem.
-	CFileSystem* fileSystem = server->getFileSystem();
-	if (!server->getSettings()->getBool("nofoldersconfig", false))
-		fileSystem = server->getFileSystem(FS_LEVEL);
+	if (fileName.isEmpty())
+		return false;
 
-	// Path-To-File
-	actualLevelName = levelName = pLevelName;
-	fileName = fileSystem->find(pLevelName);
-	modTime = fileSystem->getModTime(pLevelName);
+	// Use the compiled copy if it is still up to date.
+	CString cacheFile;
+	bool useCache = server->getSettings()->getBool("levelcache", false);
+	if (useCache)
+	{
+		cacheFile = CString() << server->getServerPath() << "levelcache/" << levelName << ".lvc";
+		if (CLevelCache::load(cacheFile, fileName, pData))
+			return true;
+	}
 
 	// Load file
 	CString fileData;
-	if (!fileData.load(fileName)) return false;
+	if (!fileData.load(fileName))
+		return false;
+
+	CString ext(getExtension(levelName));
+	bool ret;
+	if (ext == ".nw") ret = parseNW(fileData, pData);
+	else if (ext == ".graal") ret = parseGraal(fileData, pData);
+	else if (ext == ".zelda") ret = parseZelda(fileData, pData);
+	else
+	{
+		// Determine the level type.
+		CString version = fileData.readChars(8);
+		fileData.setRead(0);
+		if (version == "GLEVNW01") ret = parseNW(fileData, pData);
+		else if (version == "GR-V1.03" || version == "GR-V1.02" || version == "GR-V1.01") ret = parseGraal(fileData, pData);
+		else if (version == "Z3-V1.04" || version == "Z3-V1.03") ret = parseZelda(fileData, pData);
+		else ret = false;
+	}
+
+	if (ret && useCache)
+		CLevelCache::save(cacheFile, fileName, pData);
+	return ret;
+}
 
+bool TLevel::parseZelda(CString& fileData, SLevelData& pData)
+{
 	// Grab file version.
-	fileVersion = fileData.readChars(8);
+	pData.fileVersion = fileData.readChars(8);
 
 	// Check if it is actually a .graal level.  The 1.39-1.41r1 client actually
 	// saved .zelda as .graal.
-	if (fileVersion.subString(0, 2) == "GR")
-		return loadGraal(pLevelName);
+	if (pData.fileVersion.subString(0, 2) == "GR")
+	{
+		fileData.setRead(0);
+		return parseGraal(fileData, pData);
+	}
 
 	int v = -1;
-	if (fileVersion == "Z3-V1.03") v = 3;
-	else if (fileVersion == "Z3-V1.04") v = 4;
+	if (pData.fileVersion == "Z3-V1.03") v = 3;
+	else if (pData.fileVersion == "Z3-V1.04") v = 4;
 	if (v == -1) return false;
 
 	// Load tiles.
-	{
-		int bits = (v > 4 ? 13 : 12);
-		int read = 0;
-		unsigned int buffer = 0;
-		unsigned short code = 0;
-		short tiles[2] = {-1,-1};
-		int boardIndex = 0;
-		int count = 1;
-		bool doubleMode = false;
-
-		// Read the tiles.
-		while (boardIndex < 64*64 && fileData.bytesLeft() != 0)
-		{
-			// Every control code/tile is either 12 or 13 bits.  WTF.
-			// Read in the bits.
-			while (read < bits)
-			{
-				buffer += ((unsigned char)fileData.readChar()) << read;
-				read += 8;
-			}
+	parseTiles(fileData, pData, (v > 4 ? 13 : 12));
 
-			// Pull out a single 12/13 bit code from the buffer.
-			code = buffer & (bits == 12 ? 0xFFF : 0x1FFF);
-			buffer >>= bits;
-			read -= bits;
+	// Load the links.
+	parseLinks(fileData, pData);
 
-			// See if we have an RLE control code.
-			// Control codes determine how the RLE scheme works.
-			if (code & (bits == 12 ? 0x800 : 0x1000))
-			{
-				// If the 0x100 bit is set, we are in a double repeat mode.
-				// {double 4}56 = 56565656
-				if (code & 0x100) doubleMode = true;
+	// Load the baddies.
+	parseBaddies(fileData, pData, v > 3);
 
-				// How many tiles do we count?
-				count = code & 0xFF;
-				continue;
-			}
+	// Load signs.
+	parseSigns(fileData, pData);
 
-			// If our count is 1, just read in a tile.  This is the default mode.
-			if (count == 1)
-			{
-				levelTiles[boardIndex++] = (short)code;
-				continue;
-			}
+	return true;
+}
 
-			// If we reach here, we have an RLE scheme.
-			// See if we are in double repeat mode or not.
-			if (doubleMode)
-			{
-				// Read in our first tile.
-				if (tiles[0] == -1)
-				{
-					tiles[0] = (short)code;
-					continue;
-				}
+bool TLevel::parseGraal(CString& fileData, SLevelData& pData)
+{
+	// Grab file version.
+	pData.fileVersion = fileData.readChars(8);
+	int v = -1;
+	if (pData.fileVersion == "GR-V1.00") v = 0;
+	else if (pData.fileVersion == "GR-V1.01") v = 1;
+	else if (pData.fileVersion == "GR-V1.02") v = 2;
+	else if (pData.fileVersion == "GR-V1.03") v = 3;
+	if (v == -1) return false;
 
-				// Read in our second tile.
-				tiles[1] = (short)code;
+	// Load tiles.
+	parseTiles(fileData, pData, (v > 0 ? 13 : 12));
 
-				// Add the tiles now.
-				for (int i = 0; i < count && boardIndex < 64*64-1; ++i)
-				{
-					levelTiles[boardIndex++] = tiles[0];
-					levelTiles[boardIndex++] = tiles[1];
-				}
+	// Load the links.
+	parseLinks(fileData, pData);
 
-				// Clean up.
-				tiles[0] = tiles[1] = -1;
-				doubleMode = false;
-				count = 1;
-			}
-			// Regular RLE scheme.
-			else
-			{
-				for (int i = 0; i < count && boardIndex < 64*64; ++i)
-					levelTiles[boardIndex++] = (short)code;
-				count = 1;
-			}
-		}
-	}
+	// Load the baddies.
+	parseBaddies(fileData, pData, true);
 
-	// Load the links.
+	// Load NPCs.
 	{
 		while (fileData.bytesLeft())
 		{
 			CString line = fileData.readString("\n");
 			if (line.length() == 0 || line == "#") break;
 
-			// Assemble the level string.
-			std::vector<CString> vline = line.tokenize();
-			CString level = vline[0];
-			if (vline.size() > 7)
-			{
-				for (unsigned int i = 0; i < vline.size() - 7; ++i)
-					level << " " << vline[1 + i];
-			}
-
-			if (fileSystem->find(level).isEmpty())
-				continue;
-
-			levelLinks.emplace_back(vline);
+			SLevelData::SNPC npc;
+			npc.x = (float)(signed char)line.readGChar();
+			npc.y = (float)(signed char)line.readGChar();
+			npc.image = line.readString("#");
+			npc.code = line.readString("").replaceAll("\xa7", "\n");
+			pData.npcs.push_back(npc);
 		}
 	}
 
-	// Load the baddies.
+	// Load chests.
+	if (v > 0)
 	{
 		while (fileData.bytesLeft())
 		{
-			signed char x = fileData.readChar();
-			signed char y = fileData.readChar();
-			signed char type = fileData.readChar();
-
-			// Ends with an invalid baddy.
-			if (x == -1 && y == -1 && type == -1)
-			{
-				fileData.readString("\n");	// Empty verses.
-				break;
-			}
+			CString line = fileData.readString("\n");
+			if (line.length() == 0 || line == "#") break;
 
-			// Add the baddy.
-			TLevelBaddy* baddy = addBaddy((float)x, (float)y, type);
-			if (baddy == nullptr)
-				continue;
+			char x = line.readGChar();
+			char y = line.readGChar();
+			char item = line.readGChar();
+			char signindex = line.readGChar();
 
-			// Only v1.04+ baddies have verses.
-			if (v > 3)
-			{
-				// Load the verses.
-				std::vector<CString> bverse = fileData.readString("\n").tokenize("\\");
-				CString props;
-				for (char j = 0; j < (char)bverse.size(); ++j)
-					props >> (char)(BDPROP_VERSESIGHT + j) >> (char)bverse[j].length() << bverse[j];
-				if (props.length() != 0) baddy->setProps(props);
-			}
+			pData.chests.push_back(TLevelChest(x, y, item, signindex));
 		}
 	}
 
 	// Load signs.
-	{
-		while (fileData.bytesLeft())
-		{
-			CString line = fileData.readString("\n");
-			if (line.length() == 0) break;
-
-			signed char x = line.readGChar();
-			signed char y = line.readGChar();
-			CString text = line.readString("");
-
-			levelSigns.push_back(TLevelSign(x, y, text, true));
-		}
-	}
+	parseSigns(fileData, pData);
 
 	return true;
 }
 
-bool TLevel::loadGraal(const CString& pLevelName)
+void TLevel::parseTiles(CString& fileData, SLevelData& pData, int bits)
 {
-	// Get the appropriate filesystem.
-	CFileSystem* fileSystem = server->getFileSystem();
-	if (!server->getSettings()->getBool("nofoldersconfig", false))
-		fileSystem = server->getFileSystem(FS_LEVEL);
-
-	// Path-To-File
-	actualLevelName = levelName = pLevelName;
-	fileName = fileSystem->find(pLevelName);
-	modTime = fileSystem->getModTime(pLevelName);
-
-	// Load file
-	CString fileData;
-	if (!fileData.load(fileName)) return false;
-
-	// Grab file version.
-	fileVersion = fileData.readChars(8);
-	int v = -1;
-	if (fileVersion == "GR-V1.00") v = 0;
-	else if (fileVersion == "GR-V1.01") v = 1;
-	else if (fileVersion == "GR-V1.02") v = 2;
-	else if (fileVersion == "GR-V1.03") v = 3;
-	if (v == -1) return false;
-
-	// Load tiles.
+	int read = 0;
+	unsigned int buffer = 0;
+	unsigned short code = 0;
+	short tiles[2] = {-1,-1};
+	int boardIndex = 0;
+	int count = 1;
+	bool doubleMode = false;
+
+	// Read the tiles.
+	while (boardIndex < 64*64 && fileData.bytesLeft() != 0)
 	{
-		int bits = (v > 0 ? 13 : 12);
-		int read = 0;
-		unsigned int buffer = 0;
-		unsigned short code = 0;
-		short tiles[2] = {-1,-1};
-		int boardIndex = 0;
-		int count = 1;
-		bool doubleMode = false;
-
-		// Read the tiles.
-		while (boardIndex < 64*64 && fileData.bytesLeft() != 0)
+		// Every control code/tile is either 12 or 13 bits.  WTF.
+		// Read in the bits.
+		while (read < bits)
 		{
-			// Every control code/tile is either 12 or 13 bits.  WTF.
-			// Read in the bits.
-			while (read < bits)
-			{
-				buffer += ((unsigned char)fileData.readChar()) << read;
-				read += 8;
-			}
+			buffer += ((unsigned char)fileData.readChar()) << read;
+			read += 8;
+		}
 
-			// Pull out a single 12/13 bit code from the buffer.
-			code = buffer & (bits == 12 ? 0xFFF : 0x1FFF);
-			buffer >>= bits;
-			read -= bits;
+		// Pull out a single 12/13 bit code from the buffer.
+		code = buffer & (bits == 12 ? 0xFFF : 0x1FFF);
+		buffer >>= bits;
+		read -= bits;
 
-			// See if we have an RLE control code.
-			// Control codes determine how the RLE scheme works.
-			if (code & (bits == 12 ? 0x800 : 0x1000))
-			{
-				// If the 0x100 bit is set, we are in a double repeat mode.
-				// {double 4}56 = 56565656
-				if (code & 0x100) doubleMode = true;
+		// See if we have an RLE control code.
+		// Control codes determine how the RLE scheme works.
+		if (code & (bits == 12 ? 0x800 : 0x1000))
+		{
+			// If the 0x100 bit is set, we are in a double repeat mode.
+			// {double 4}56 = 56565656
+			if (code & 0x100) doubleMode = true;
 
-				// How many tiles do we count?
-				count = code & 0xFF;
-				continue;
-			}
+			// How many tiles do we count?
+			count = code & 0xFF;
+			continue;
+		}
 
-			// If our count is 1, just read in a tile.  This is the default mode.
-			if (count == 1)
+		// If our count is 1, just read in a tile.  This is the default mode.
+		if (count == 1)
+		{
+			pData.tiles[boardIndex++] = (short)code;
+			continue;
+		}
+
+		// If we reach here, we have an RLE scheme.
+		// See if we are in double repeat mode or not.
+		if (doubleMode)
+		{
+			// Read in our first tile.
+			if (tiles[0] == -1)
 			{
-				levelTiles[boardIndex++] = (short)code;
+				tiles[0] = (short)code;
 				continue;
 			}
 
-			// If we reach here, we have an RLE scheme.
-			// See if we are in double repeat mode or not.
-			if (doubleMode)
-			{
-				// Read in our first tile.
-				if (tiles[0] == -1)
-				{
-					tiles[0] = (short)code;
-					continue;
-				}
-
-				// Read in our second tile.
-				tiles[1] = (short)code;
-
-				// Add the tiles now.
-				for (int i = 0; i < count && boardIndex < 64*64-1; ++i)
-				{
-					levelTiles[boardIndex++] = tiles[0];
-					levelTiles[boardIndex++] = tiles[1];
-				}
+			// Read in our second tile.
+			tiles[1] = (short)code;
 
-				// Clean up.
-				tiles[0] = tiles[1] = -1;
-				doubleMode = false;
-				count = 1;
-			}
-			// Regular RLE scheme.
-			else
+			// Add the tiles now.
+			for (int i = 0; i < count && boardIndex < 64*64-1; ++i)
 			{
-				for (int i = 0; i < count && boardIndex < 64*64; ++i)
-					levelTiles[boardIndex++] = (short)code;
-				count = 1;
+				pData.tiles[boardIndex++] = tiles[0];
+				pData.tiles[boardIndex++] = tiles[1];
 			}
-		}
-	}
 
-	// Load the links.
-	{
-		while (fileData.bytesLeft())
+			// Clean up.
+			tiles[0] = tiles[1] = -1;
+			doubleMode = false;
+			count = 1;
+		}
+		// Regular RLE scheme.
+		else
 		{
-			CString line = fileData.readString("\n");
-			if (line.length() == 0 || line == "#") break;
-
-			// Assemble the level string.
-			std::vector<CString> vline = line.tokenize();
-			CString level = vline[0];
-			if (vline.size() > 7)
-			{
-				for (unsigned int i = 0; i < vline.size() - 7; ++i)
-					level << " " << vline[1 + i];
-			}
-
-			if (fileSystem->find(level).isEmpty())
-				continue;
-
-			levelLinks.push_back(TLevelLink(vline));
+			for (int i = 0; i < count && boardIndex < 64*64; ++i)
+				pData.tiles[boardIndex++] = (short)code;
+			count = 1;
 		}
 	}
+}
 
-	// Load the baddies.
+void TLevel::parseLinks(CString& fileData, SLevelData& pData)
+{
+	while (fileData.bytesLeft())
 	{
-		while (fileData.bytesLeft())
-		{
-			signed char x = fileData.readChar();
-			signed char y = fileData.readChar();
-			signed char type = fileData.readChar();
+		CString line = fileData.readString("\n");
+		if (line.length() == 0 || line == "#") break;
 
-			// Ends with an invalid baddy.
-			if (x == -1 && y == -1 && type == -1)
-			{
-				fileData.readString("\n");	// Empty verses.
-				break;
-			}
-
-			// Add the baddy.
-			TLevelBaddy* baddy = addBaddy((float)x, (float)y, type);
-			if (baddy == nullptr)
-				continue;
-
-			// Load the verses.
-			std::vector<CString> bverse = fileData.readString("\n").tokenize("\\");
-			CString props;
-			for (char j = 0; j < (char)bverse.size(); ++j)
-				props >> (char)(BDPROP_VERSESIGHT + j) >> (char)bverse[j].length() << bverse[j];
-			if (props.length() != 0) baddy->setProps(props);
-		}
+		pData.links.push_back(line.tokenize());
 	}
+}
 
-	// Load NPCs.
+void TLevel::parseBaddies(CString& fileData, SLevelData& pData, bool hasVerses)
+{
+	while (fileData.bytesLeft())
 	{
-		while (fileData.bytesLeft())
-		{
-			CString line = fileData.readString("\n");
-			if (line.length() == 0 || line == "#") break;
-
-			signed char x = line.readGChar();
-			signed char y = line.readGChar();
-			CString image = line.readString("#");
-			CString code = line.readString("").replaceAll("\xa7", "\n");
+		signed char x = fileData.readChar();
+		signed char y = fileData.readChar();
+		signed char type = fileData.readChar();
 
-			TNPC* npc = server->addNPC(image, code, x, y, this, true, false);
-			levelNPCs.push_back(npc);
+		// Ends with an invalid baddy.
+		if (x == -1 && y == -1 && type == -1)
+		{
+			fileData.readString("\n");	// Empty verses.
+			break;
 		}
-	}
 
-	// Load chests.
-	if (v > 0)
-	{
-		while (fileData.bytesLeft())
-		{
-			CString line = fileData.readString("\n");
-			if (line.length() == 0 || line == "#") break;
+		// Limit of 50 baddies per level.
+		if (pData.baddies.size() > 50)
+			continue;
 
-			char x = line.readGChar();
-			char y = line.readGChar();
-			char item = line.readGChar();
-			char signindex = line.readGChar();
+		SLevelData::SBaddy baddy;
+		baddy.x = (float)x;
+		baddy.y = (float)y;
+		baddy.type = type;
 
-			levelChests.push_back(TLevelChest(x, y, item, signindex));
+		// Load the verses.
+		if (hasVerses)
+		{
+			std::vector<CString> bverse = fileData.readString("\n").tokenize("\\");
+			for (char j = 0; j < (char)bverse.size(); ++j)
+				baddy.props >> (char)(BDPROP_VERSESIGHT + j) >> (char)bverse[j].length() << bverse[j];
 		}
+		pData.baddies.push_back(baddy);
 	}
+}
 
-	// Load signs.
+void TLevel::parseSigns(CString& fileData, SLevelData& pData)
+{
+	while (fileData.bytesLeft())
 	{
-		while (fileData.bytesLeft())
-		{
-			CString line = fileData.readString("\n");
-			if (line.length() == 0) break;
-
-			signed char x = line.readGChar();
-			signed char y = line.readGChar();
-			CString text = line.readString("");
-
-			levelSigns.push_back(TLevelSign(x, y, text, true));
-		}
+		CString line = fileData.readString("\n");
+		if (line.length() == 0) break;
+
+		SLevelData::SSign sign;
+		sign.x = (signed char)line.readGChar();
+		sign.y = (signed char)line.readGChar();
+		sign.text = line.readString("");
+		sign.encoded = true;
+		pData.signs.push_back(sign);
 	}
-
-	return true;
 }
 
-bool TLevel::loadNW(const CString& pLevelName)
+bool TLevel::parseNW(CString& fileData, SLevelData& pData)
 {
-	// Get the appropriate filesystem.
-	CFileSystem* fileSystem = server->getFileSystem();
-	if (!server->getSettings()->getBool("nofoldersconfig", false))
-		fileSystem = server->getFileSystem(FS_LEVEL);
-
-	// Path-To-File
-	actualLevelName = levelName = pLevelName;
-	fileName = fileSystem->find(pLevelName);
-	modTime = fileSystem->getModTime(pLevelName);
-
-	// Load File
-	std::vector<CString> fileData = CString::loadToken(fileName, "\n", true);
-	if (fileData.empty())
+	fileData.removeAllI("\r");
+	std::vector<CString> lines = fileData.tokenize("\n");
+	if (lines.empty())
 		return false;
 
 	// Grab File Version
-	fileVersion = fileData[0];
+	pData.fileVersion = lines[0];
 
 	// Parse Level
-	for (std::vector<CString>::iterator i = fileData.begin(); i != fileData.end(); ++i)
+	for (std::vector<CString>::iterator i = lines.begin(); i != lines.end(); ++i)
 	{
 		// Tokenize
 		std::vector<CString> curLine = i->tokenize();
@@ -788,7 +718,7 @@ bool TLevel::loadNW(const CString& pLevelName)
 					char top = curLine[5].readChar();
 					short tile = base64.find(left) << 6;
 					tile += base64.find(top);
-					levelTiles[ii + y*64] = tile;
+					pData.tiles[ii + y*64] = tile;
 				}
 			}
 		}
@@ -802,7 +732,7 @@ bool TLevel::loadNW(const CString& pLevelName)
 				char chestx = strtoint(curLine[1]);
 				char chesty = strtoint(curLine[2]);
 				char signidx = strtoint(curLine[4]);
-				levelChests.push_back(TLevelChest(chestx, chesty, itemidx, signidx));
+				pData.chests.push_back(TLevelChest(chestx, chesty, itemidx, signidx));
 			}
 		}
 		else if (curLine[0] == "LINK")
@@ -811,21 +741,7 @@ bool TLevel::loadNW(const CString& pLevelName)
 				continue;
 
 			// Get link string.
-			std::vector<CString>::iterator i = curLine.begin();
-			std::vector<CString> link(++i, curLine.end());
-
-			// Find the whole level name.
-			CString level(link[0]);
-			if (link.size() > 7)
-			{
-				for (auto i = 0; i < link.size() - 7; ++i)
-					level << " " << link[i + 1];
-			}
-
-			if (fileSystem->find(level).isEmpty())
-				continue;
-
-			levelLinks.push_back(TLevelLink(link));
+			pData.links.emplace_back(curLine.begin() + 1, curLine.end());
 		}
 		else if (curLine[0] == "NPC")
 		{
@@ -834,82 +750,83 @@ bool TLevel::loadNW(const CString& pLevelName)
 				continue;
 
 			// Grab the image properties.
-			CString image(curLine[1]);
+			SLevelData::SNPC npc;
+			npc.image = curLine[1];
 			if (curLine.size() > 4)
 			{
 				offset = (int)curLine.size() - 4;
 				for (unsigned int i = 0; i < offset; ++i)
-					image << " " << curLine[i + 2];
+					npc.image << " " << curLine[i + 2];
 			}
 
 			// Grab the NPC location.
-			float x = (float)strtofloat(curLine[2 + offset]);
-			float y = (float)strtofloat(curLine[3 + offset]);
+			npc.x = (float)strtofloat(curLine[2 + offset]);
+			npc.y = (float)strtofloat(curLine[3 + offset]);
 
 			// Grab the NPC code.
-			CString code;
 			++i;
-			while (i != fileData.end())
+			while (i != lines.end())
 			{
 				if (*i == "NPCEND") break;
-				code << *i << "\n";
+				npc.code << *i << "\n";
 				++i;
 			}
-			//printf( "image: %s, x: %.2f, y: %.2f, code: %s\n", image.text(), x, y, code.text() );
+
 			// Add the new NPC.
-			TNPC* npc = server->addNPC(image, code, x, y, this, true, false);
-			levelNPCs.push_back(npc);
+			pData.npcs.push_back(npc);
 		}
 		else if (curLine[0] == "SIGN")
 		{
 			if (curLine.size() != 3)
 				continue;
 
-			int x = strtoint(curLine[1]);
-			int y = strtoint(curLine[2]);
+			SLevelData::SSign sign;
+			sign.x = strtoint(curLine[1]);
+			sign.y = strtoint(curLine[2]);
+			sign.encoded = false;
 
 			// Grab the sign code.
-			CString text;
 			++i;
-			while (i != fileData.end())
+			while (i != lines.end())
 			{
 				if (*i == "SIGNEND") break;
-				text << *i << "\n";
+				sign.text << *i << "\n";
 				++i;
 			}
 
 			// Add the new sign.
-			levelSigns.push_back(TLevelSign(x, y, text));
+			pData.signs.push_back(sign);
 		}
 		else if (curLine[0] == "BADDY")
 		{
 			if (curLine.size() != 4)
 				continue;
 
-			int x = strtoint(curLine[1]);
-			int y = strtoint(curLine[2]);
-			int type = strtoint(curLine[3]);
-
-			// Add the baddy.
-			TLevelBaddy* baddy = addBaddy((float)x, (float)y, type);
-			if (baddy == 0)
+			// Limit of 50 baddies per level.
+			if (pData.baddies.size() > 50)
 				continue;
 
+			SLevelData::SBaddy baddy;
+			baddy.x = (float)strtoint(curLine[1]);
+			baddy.y = (float)strtoint(curLine[2]);
+			baddy.type = (char)strtoint(curLine[3]);
+
 			// Load the verses.
 			std::vector<CString> bverse;
 			++i;
-			while (i != fileData.end())
+			while (i != lines.end())
 			{
 				if (*i == "BADDYEND") break;
 				bverse.push_back(*i);
 				++i;
 			}
-			CString props;
 			for (char j = 0; j < (char)bverse.size(); ++j)
-				props >> (char)(BDPROP_VERSESIGHT + j) >> (char)bverse[j].length() << bverse[j];
-			if (props.length() != 0) baddy->setProps(props);
+				baddy.props >> (char)(BDPROP_VERSESIGHT + j) >> (char)bverse[j].length() << bverse[j];
+
+			// Add the baddy.
+			pData.baddies.push_back(baddy);
 		}
-		if (i == fileData.end()) break;
+		if (i == lines.end()) break;
 	}
 
 	return true;
@@ -920,30 +837,34 @@ bool TLevel::loadNW(const CString& pLevelName)
 */
 TLevel* TLevel::findLevel(const CString& pLevelName, TServer* server)
 {
-	std::vector<TLevel*>* levelList = server->getLevelList();
-
-	// TODO(joey): Maybe its time for a hashmap, even if a duplicate level name occurs
-	// 	this is still going to break on the first occurence.
+	// Levels are looked up by their lowercase name.
+	std::string levelKey(pLevelName.toLower().text());
 
 	// Find Appropriate Level by Name
-	for (auto it = levelList->begin(); it != levelList->end(); )
-	{
-		if ((*it)->getLevelName().toLower() == pLevelName.toLower())
-			return (*it);
-
-		++it;
-	}
+	auto levelIndex = server->getLevelIndex();
+	auto it = levelIndex->find(levelKey);
+	if (it != levelIndex->end())
+		return it->second;
+
+	// Don't hit the disk again for levels we already know don't exist.
+	auto missingLevels = server->getMissingLevels();
+	if (missingLevels->find(levelKey) != missingLevels->end())
+		return nullptr;
 
 	// Load New Level
 	TLevel *level = new TLevel(server);
 	if (!level->loadLevel(pLevelName))
 	{
 		delete level;
+		if (missingLevels->size() >= SERVER_MISSINGLEVELS)
+			missingLevels->clear();
+		missingLevels->insert(levelKey);
 		return nullptr;
 	}
 
 	// Return Level
-	levelList->push_back(level);
+	server->getLevelList()->push_back(level);
+	(*levelIndex)[std::string(level->getLevelName().toLower().text())] = level;
 	return level;
 }
 
@@ -1028,6 +949,7 @@ bool TLevel::alterBoard(CString& pTileData, int pX, int pY, int pWidth, int pHei
 	// These are things like signs, bushes, pots, etc.
 	int respawnTime = settings->getInt("respawntime", 15);
 	bool doRespawn = false;
+	const short* levelTiles = levelTemplate->data.tiles;
 	short testTile = levelTiles[pX + (pY * 64)];
 	int tileCount = sizeof(respawningTiles) / sizeof(short);
 	for (int i = 0; i < tileCount; ++i)
@@ -1046,13 +968,16 @@ bool TLevel::alterBoard(CString& pTileData, int pX, int pY, int pWidth, int pHei
 
 	// TODO: old gserver didn't save the board change if oldTiles.length() == 0.
 	// Should we do it that way still?
-	levelBoardChanges.push_back(new TLevelBoardChange(pX, pY, pWidth, pHeight, pTileData, oldTiles, (doRespawn ? respawnTime : -1)));
+	auto change = new TLevelBoardChange(pX, pY, pWidth, pHeight, pTileData, oldTiles, (doRespawn ? respawnTime : -1));
+	levelBoardChanges.push_back(change);
+	scheduleTimedEvent(change->timeout.getDue());
 	return true;
 }
 
 bool TLevel::addItem(float pX, float pY, char pItem)
 {
 	levelItems.push_back(TLevelItem(pX, pY, pItem));
+	scheduleTimedEvent(levelItems.back().timeout.getDue());
 	return true;
 }
 
@@ -1075,6 +1000,8 @@ bool TLevel::addHorse(CString& pImage, float pX, float pY, char pDir, char pBush
 {
 	auto horseLife = server->getSettings()->getInt("horselifetime", 30);
 	levelHorses.push_back(TLevelHorse(horseLife, pImage, pX, pY, pDir, pBushes));
+	horsePacket.clear();
+	scheduleTimedEvent(levelHorses.back().timeout.getDue());
 	return true;
 }
 
@@ -1086,6 +1013,7 @@ void TLevel::removeHorse(float pX, float pY)
 		if (horse.getX() == pX && horse.getY() == pY)
 		{
 			levelHorses.erase(it);
+			horsePacket.clear();
 			return;
 		}
 	}
@@ -1099,6 +1027,7 @@ TLevelBaddy* TLevel::addBaddy(float pX, float pY, char pType)
 	// New Baddy
 	TLevelBaddy* newBaddy = new TLevelBaddy(pX, pY, pType, this, server);
 	levelBaddies.push_back(newBaddy);
+	invalidateBaddyPackets();
 
 	// Assign Baddy Id
 	// Don't assign id 0.
@@ -1140,6 +1069,7 @@ void TLevel::removeBaddy(char pId)
 	}
 	//vecRemove(levelBaddies, baddy);
 	levelBaddyIds[pId] = 0;
+	invalidateBaddyPackets();
 
 	// Clean up.
 	delete baddy;
@@ -1190,9 +1120,33 @@ TPlayer* TLevel::getPlayer(unsigned int id)
 	return levelPlayerList[id];
 }
 
+void TLevel::cacheMap() const
+{
+	levelMap = server->getMap(this);
+	mapX = (levelMap ? levelMap->getLevelX(actualLevelName) : 0);
+	mapY = (levelMap ? levelMap->getLevelY(actualLevelName) : 0);
+	mapVersion = server->getMapListVersion();
+}
+
 TMap* TLevel::getMap() const
 {
-	return server->getMap(this);
+	if (mapVersion != server->getMapListVersion())
+		cacheMap();
+	return levelMap;
+}
+
+int TLevel::getMapX() const
+{
+	if (mapVersion != server->getMapListVersion())
+		cacheMap();
+	return mapX;
+}
+
+int TLevel::getMapY() const
+{
+	if (mapVersion != server->getMapListVersion())
+		cacheMap();
+	return mapY;
 }
 
 bool TLevel::addNPC(TNPC* npc)
@@ -1202,6 +1156,10 @@ bool TLevel::addNPC(TNPC* npc)
 	}
 
 	levelNPCs.push_back(npc);
+#ifdef V8NPCSERVER
+	removeNPCFromGrid(npc);
+	addNPCToGrid(npc);
+#endif
 	return true;
 }
 
@@ -1214,16 +1172,34 @@ void TLevel::removeNPC(TNPC* npc)
 			i = levelNPCs.erase(i);
 		else ++i;
 	}
+
+#ifdef V8NPCSERVER
+	removeNPCFromGrid(npc);
+#endif
 }
 
 bool TLevel::doTimedEvents()
 {
+	// Our timer has been used up.  Anything still waiting gets rescheduled below.
+	if (timedEventDue >= 0)
+	{
+		server->getLevelTimers()->remove(this, timedEventDue);
+		timedEventDue = -1;
+	}
+
+	long long now = getTimerSeconds();
+	long long nextDue = -1;
+	auto updateNextDue = [&nextDue](const CDeadline& timeout)
+	{
+		if (timeout.isSet() && (nextDue < 0 || timeout.getDue() < nextDue))
+			nextDue = timeout.getDue();
+	};
+
 	// Check if we should revert any board changes.
 	for (std::vector<TLevelBoardChange*>::iterator i = levelBoardChanges.begin(); i != levelBoardChanges.end(); ++i)
 	{
 		TLevelBoardChange* change = *i;
-		int respawnTimer = change->timeout.doTimeout();
-		if (respawnTimer == 0)
+		if (change->timeout.expire(now))
 		{
 			// Put the old data back in.  DON'T DELETE THE CHANGE.
 			// The client remembers board changes and if we delete the
@@ -1232,6 +1208,7 @@ bool TLevel::doTimedEvents()
 			change->setModTime(time(0));
 			server->sendPacketToLevel(CString() >> (char)PLO_BOARDMODIFY << change->getBoardStr(), 0, this);
 		}
+		else updateNextDue(change->timeout);
 	}
 
 	// Check if any items have timed out.
@@ -1240,28 +1217,36 @@ bool TLevel::doTimedEvents()
 	for (std::vector<TLevelItem>::iterator i = levelItems.begin(); i != levelItems.end(); )
 	{
 		TLevelItem& item = *i;
-		int deleteTimer = item.timeout.doTimeout();
-		if (deleteTimer == 0)
+		if (item.timeout.expire(now))
 		{
 			i = levelItems.erase(i);
 		}
-		else ++i;
+		else
+		{
+			updateNextDue(item.timeout);
+			++i;
+		}
 	}
 
 	// Check if any horses need to be deleted.
 	for (std::vector<TLevelHorse>::iterator i = levelHorses.begin(); i != levelHorses.end(); )
 	{
 		TLevelHorse& horse = *i;
-		int deleteTimer = horse.timeout.doTimeout();
-		if (deleteTimer == 0)
+		if (horse.timeout.expire(now))
 		{
 			server->sendPacketToLevel(CString() >> (char)PLO_HORSEDEL >> (char)(horse.getX() * 2) >> (char)(horse.getY() * 2), 0, this);
 			i = levelHorses.erase(i);
+			horsePacket.clear();
+		}
+		else
+		{
+			updateNextDue(horse.timeout);
+			++i;
 		}
-		else ++i;
 	}
 
 	// Check if any baddies need to be marked as dead or respawned.
+	// Setting baddy props schedules their next event on its own.
 	std::set<TLevelBaddy*> set_dead;
 	for (std::vector<TLevelBaddy *>::iterator i = levelBaddies.begin(); i != levelBaddies.end(); )
 	{
@@ -1274,8 +1259,7 @@ bool TLevel::doTimedEvents()
 		++i;
 
 		// See if we can respawn him.
-		int respawnTimer = baddy->timeout.doTimeout();
-		if (respawnTimer == 0)
+		if (baddy->timeout.expire(now))
 		{
 			if (baddy->getType() == 4 /*swamp arrow baddy*/ && baddy->getMode() == BDMODE_HURT)
 			{
@@ -1309,6 +1293,7 @@ bool TLevel::doTimedEvents()
 				}
 			}
 		}
+		else updateNextDue(baddy->timeout);
 	}
 	{	// Mark all the baddies as dead now.
 		CString props = CString() >> (char)BDPROP_MODE >> (char)BDMODE_DEAD;
@@ -1319,24 +1304,41 @@ bool TLevel::doTimedEvents()
 		}
 	}
 
+	scheduleTimedEvent(nextDue);
 	return true;
 }
 
+void TLevel::scheduleTimedEvent(long long pDue)
+{
+	if (pDue < 0)
+		return;
+
+	// Already going to run by then.
+	if (timedEventDue >= 0 && timedEventDue <= pDue)
+		return;
+
+	CTimerWheel* timers = server->getLevelTimers();
+	if (timedEventDue >= 0)
+		timers->remove(this, timedEventDue);
+	timers->add(this, pDue);
+	timedEventDue = pDue;
+}
+
 bool TLevel::isOnWall(double pX, double pY) const
 {
 	if (pX < 0 || pY < 0 || pX > 63 || pY > 63) return true;
 
-	return tiletypes[levelTiles[int(round(pY)) * 64 + int(round(pX))]] >= 20;
+	return tiletypes[levelTemplate->data.tiles[int(round(pY)) * 64 + int(round(pX))]] >= 20;
 }
 
 bool TLevel::isOnWater(double pX, double pY) const
 {
-	return (tiletypes[levelTiles[(int)pY * 64 + (int)pX]] == 11);
+	return (tiletypes[levelTemplate->data.tiles[(int)pY * 64 + (int)pX]] == 11);
 }
 
 std::optional<TLevelLink> TLevel::getLink(int pX, int pY) const
 {
-	for (auto& link : levelLinks)
+	for (auto& link : levelTemplate->links)
 	{
 		if ((pX >= link.getX() && pY <= link.getX() + link.getWidth()) &&
 			(pY >= link.getY() && pY <= link.getY() + link.getHeight()))
@@ -1350,7 +1352,7 @@ std::optional<TLevelLink> TLevel::getLink(int pX, int pY) const
 
 std::optional<TLevelChest> TLevel::getChest(int x, int y) const
 {
-	for (auto& chest : levelChests)
+	for (auto& chest : levelTemplate->data.chests)
 	{
 		if (chest.getX() == x && chest.getY() == y)
 		{
@@ -1369,18 +1371,93 @@ CString TLevel::getChestStr(const TLevelChest& chest) const
 }
 
 #ifdef V8NPCSERVER
+// Returns the grid cell a pixel coordinate falls in.  Anything off the board
+// goes into the edge cells.
+static inline int getNPCGridCell(int pixel)
+{
+	if (pixel < 0) return 0;
+	int cell = pixel / NPCGRID_CELLSIZE;
+	return (cell >= NPCGRID_SIZE ? NPCGRID_SIZE - 1 : cell);
+}
+
+void TLevel::updateNPCGrid(TNPC* npc)
+{
+	// Only track NPCs that are actually in the level.
+	auto it = npcGridAreas.find(npc);
+	if (it == npcGridAreas.end())
+		return;
+
+	// Nothing to do if it is still covering the same cells.
+	const SNPCGridArea& old = it->second;
+	if (old.left == getNPCGridCell(npc->getPixelX()) && old.top == getNPCGridCell(npc->getPixelY()) &&
+		old.right == getNPCGridCell(npc->getPixelX() + npc->getWidth()) && old.bottom == getNPCGridCell(npc->getPixelY() + npc->getHeight()))
+		return;
+
+	removeNPCFromGrid(npc);
+	addNPCToGrid(npc);
+}
+
+void TLevel::addNPCToGrid(TNPC* npc)
+{
+	SNPCGridArea area;
+	area.left = getNPCGridCell(npc->getPixelX());
+	area.top = getNPCGridCell(npc->getPixelY());
+	area.right = getNPCGridCell(npc->getPixelX() + npc->getWidth());
+	area.bottom = getNPCGridCell(npc->getPixelY() + npc->getHeight());
+
+	if (npcGrid.empty())
+		npcGrid.resize(NPCGRID_SIZE * NPCGRID_SIZE);
+
+	for (int cy = area.top; cy <= area.bottom; ++cy)
+	{
+		for (int cx = area.left; cx <= area.right; ++cx)
+			npcGrid[cy * NPCGRID_SIZE + cx].push_back(npc);
+	}
+	npcGridAreas[npc] = area;
+}
+
+void TLevel::removeNPCFromGrid(TNPC* npc)
+{
+	auto it = npcGridAreas.find(npc);
+	if (it == npcGridAreas.end())
+		return;
+
+	const SNPCGridArea& area = it->second;
+	for (int cy = area.top; cy <= area.bottom; ++cy)
+	{
+		for (int cx = area.left; cx <= area.right; ++cx)
+		{
+			std::vector<TNPC *>& cell = npcGrid[cy * NPCGRID_SIZE + cx];
+			cell.erase(std::remove(cell.begin(), cell.end(), npc), cell.end());
+		}
+	}
+	npcGridAreas.erase(it);
+}
+
 std::vector<TNPC *> TLevel::findAreaNpcs(int pX, int pY, int pWidth, int pHeight)
 {
 	int testEndX = pX + pWidth;
 	int testEndY = pY + pHeight;
 
 	std::vector<TNPC *> npcList;
-	for (const auto& npc : levelNPCs)
+	if (npcGrid.empty())
+		return npcList;
+
+	// NPCs can cover several cells, so make sure we only return them once.
+	std::unordered_set<TNPC *> found;
+	for (int cy = getNPCGridCell(pY); cy <= getNPCGridCell(testEndY); ++cy)
 	{
-		if (pX < npc->getPixelX() + npc->getWidth() && testEndX > npc->getPixelX() &&
-			pY < npc->getPixelY() + npc->getHeight() && testEndY > npc->getPixelY())
+		for (int cx = getNPCGridCell(pX); cx <= getNPCGridCell(testEndX); ++cx)
 		{
-			npcList.push_back(npc);
+			for (const auto& npc : npcGrid[cy * NPCGRID_SIZE + cx])
+			{
+				if (pX < npc->getPixelX() + npc->getWidth() && testEndX > npc->getPixelX() &&
+					pY < npc->getPixelY() + npc->getHeight() && testEndY > npc->getPixelY())
+				{
+					if (found.insert(npc).second)
+						npcList.push_back(npc);
+				}
+			}
 		}
 	}
 
@@ -1390,7 +1467,10 @@ std::vector<TNPC *> TLevel::findAreaNpcs(int pX, int pY, int pWidth, int pHeight
 std::vector<TNPC*> TLevel::testTouch(int pX, int pY)
 {
 	std::vector<TNPC*> npcList;
-	for (const auto& npc : levelNPCs)
+	if (npcGrid.empty())
+		return npcList;
+
+	for (const auto& npc : npcGrid[getNPCGridCell(pY) * NPCGRID_SIZE + getNPCGridCell(pX)])
 	{
 		if (npc->hasScriptEvent(NPCEVENTFLAG_PLAYERTOUCHSME) && (npc->getVisibleFlags() & NPCVISFLAG_VISIBLE) != 0)
 		{
@@ -1407,7 +1487,10 @@ std::vector<TNPC*> TLevel::testTouch(int pX, int pY)
 
 TNPC * TLevel::isOnNPC(int pX, int pY, bool checkEventFlag)
 {
-	for (const auto& npc : levelNPCs)
+	if (npcGrid.empty())
+		return nullptr;
+
+	for (const auto& npc : npcGrid[getNPCGridCell(pY) * NPCGRID_SIZE + getNPCGridCell(pX)])
 	{
 		if (checkEventFlag && !npc->hasScriptEvent(NPCEVENTFLAG_PLAYERTOUCHSME))
 			continue;
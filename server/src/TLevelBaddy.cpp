@@ -40,6 +40,9 @@ void TLevelBaddy::reset()
 	dir = (2 << 2) | 2;			// Both head/body direction is encoded in dir.
 	ani = 0;
 	setImage = false;
+
+	if (level)
+		level->invalidateBaddyPackets();
 }
 
 void TLevelBaddy::dropItem()
@@ -205,6 +208,10 @@ void TLevelBaddy::setProps(CString &pProps)
 						return;
 					}
 				}
+
+				// Let the level know when to run our timeout.
+				if (level && timeout.isSet())
+					level->scheduleTimedEvent(timeout.getDue());
 			break;
 
 			case BDPROP_ANI:
@@ -226,4 +233,8 @@ void TLevelBaddy::setProps(CString &pProps)
 			}
 		}
 	}
+
+	// The level's cached baddy packets are out of date now.
+	if (level)
+		level->invalidateBaddyPackets();
 }
@@ -1,61 +1,78 @@
 #include "IDebug.h"
 #include <map>
 #include <vector>
+#include <algorithm>
 
 #include "CFileSystem.h"
 #include "TMap.h"
 #include "TServer.h"
 
 TMap::TMap(int pType, bool pGroupMap)
-: type(pType), modTime(0), width(0), height(0), groupMap(pGroupMap)
+: type(pType), modTime(0), width(0), height(0), groupMap(pGroupMap), gridWidth(0), gridHeight(0)
 {
 }
 
 TMap::TMap(int pType, const CString& pFileName, TServer* pServer, bool pGroupMap)
-: type(pType), modTime(0), width(0), height(0), groupMap(pGroupMap)
+: type(pType), modTime(0), width(0), height(0), groupMap(pGroupMap), gridWidth(0), gridHeight(0)
 {
 	load(pFileName, pServer);
 }
 
 bool TMap::load(const CString& pFileName, TServer* pServer)
 {
+	bool ret = true;
 	if (type == MAPTYPE_BIGMAP)
-		return loadBigMap(pFileName, pServer);
+		ret = loadBigMap(pFileName, pServer);
 	else if (type == MAPTYPE_GMAP)
-		return loadGMap(pFileName, pServer);
-	return true;
+		ret = loadGMap(pFileName, pServer);
+
+	buildLevelGrid();
+	return ret;
 }
 
-bool TMap::isLevelOnMap(const CString& level) const
+void TMap::buildLevelGrid()
 {
-	for (std::map<CString, SMapLevel>::const_iterator i = levels.begin(); i != levels.end(); ++i)
+	// Size the grid by the levels we actually have, the gmap header might not match.
+	gridWidth = gridHeight = 0;
+	for (auto& level : levels)
 	{
-		if (i->first == level)
-			return true;
+		if (level.second.mapx + 1 > gridWidth) gridWidth = level.second.mapx + 1;
+		if (level.second.mapy + 1 > gridHeight) gridHeight = level.second.mapy + 1;
 	}
-	return false;
+
+	levelGrid.clear();
+	levelGrid.resize(gridWidth * gridHeight);
+	for (auto& level : levels)
+	{
+		if (level.second.mapx < 0 || level.second.mapy < 0) continue;
+		levelGrid[level.second.mapy * gridWidth + level.second.mapx] = CString(level.first.c_str());
+	}
+}
+
+bool TMap::isLevelOnMap(const CString& level) const
+{
+	return (levels.find(level.text()) != levels.end());
 }
 
 CString TMap::getLevelAt(int x, int y) const
 {
-	for (std::map<CString, SMapLevel>::const_iterator i = levels.begin(); i != levels.end(); ++i)
-	{
-		if (i->second.mapx == x && i->second.mapy == y)
-			return i->first;
-	}
-	return CString();
+	if (x < 0 || y < 0 || x >= gridWidth || y >= gridHeight)
+		return CString();
+	return levelGrid[y * gridWidth + x];
 }
 
 int TMap::getLevelX(const CString& level) const
 {
-	if (levels.empty()) return 0;
-	return levels.find(level)->second.mapx;
+	auto it = levels.find(level.text());
+	if (it == levels.end()) return 0;
+	return it->second.mapx;
 }
 
 int TMap::getLevelY(const CString& level) const
 {
-	if (levels.empty()) return 0;
-	return levels.find(level)->second.mapy;
+	auto it = levels.find(level.text());
+	if (it == levels.end()) return 0;
+	return it->second.mapy;
 }
 
 bool TMap::loadBigMap(const CString& pFileName, TServer* pServer)
@@ -100,7 +117,7 @@ bool TMap::loadBigMap(const CString& pFileName, TServer* pServer)
 
 			// Save the level into the map.
 			SMapLevel lvl(bmapx++, bmapy);
-			levels[*j] = lvl;
+			levels[j->text()] = lvl;
 		}
 
 		if (bmapx > width) width = bmapx;
@@ -187,7 +204,7 @@ bool TMap::loadGMap(const CString& pFileName, TServer* pServer)
 
 					// Save the level into the map.
 					SMapLevel lvl(gmapx++, gmapy);
-					levels[*j] = lvl;
+					levels[j->text()] = lvl;
 				}
 
 				gmapx = 0;
@@ -237,10 +254,49 @@ CString TMap::getLevels()
 {
 	CString retVal;
 	
-	for (std::map<CString, SMapLevel>::const_iterator i = levels.begin(); i != levels.end(); ++i)
+	for (auto i = levels.begin(); i != levels.end(); ++i)
 	{
-		retVal << i->first << "\n";
+		retVal << i->first.c_str() << "\n";
 	}
 	
 	return retVal;
 }
+
+void TMap::setPlayerCell(TPlayer* player, int x, int y)
+{
+	int key = getCellKey(x, y);
+
+	auto it = playerCellKeys.find(player);
+	if (it != playerCellKeys.end())
+	{
+		if (it->second == key)
+			return;
+		removePlayer(player);
+	}
+
+	playerCells[key].push_back(player);
+	playerCellKeys[player] = key;
+}
+
+void TMap::removePlayer(TPlayer* player)
+{
+	auto it = playerCellKeys.find(player);
+	if (it == playerCellKeys.end())
+		return;
+
+	auto cell = playerCells.find(it->second);
+	if (cell != playerCells.end())
+	{
+		std::vector<TPlayer*>& list = cell->second;
+		auto pos = std::find(list.begin(), list.end(), player);
+		if (pos != list.end())
+		{
+			*pos = list.back();
+			list.pop_back();
+		}
+		if (list.empty())
+			playerCells.erase(cell);
+	}
+
+	playerCellKeys.erase(it);
+}
@@ -40,8 +40,8 @@ TNPC::TNPC(const CString& pImage, const CString& pScript, float pX, float pY, TS
 		TMap *gmap = level->getMap();
 		if (gmap && gmap->getType() == MAPTYPE_GMAP)
 		{
-			gmaplevelx = (unsigned char) gmap->getLevelX(level->getLevelName());
-			gmaplevely = (unsigned char) gmap->getLevelY(level->getLevelName());
+			gmaplevelx = (unsigned char) level->getMapX();
+			gmaplevely = (unsigned char) level->getMapY();
 		}
 
 #ifdef V8NPCSERVER
@@ -309,10 +309,10 @@ CString TNPC::getProp(unsigned char pId, int clientVersion) const
 			return CString() >> (char)bodyImage.length() << bodyImage;
 
 		case NPCPROP_GMAPLEVELX:
-			return CString() >> (char)(level && level->getMap() ? level->getMap()->getLevelX(level->getActualLevelName()) : 0);
+			return CString() >> (char)(level ? level->getMapX() : 0);
 
 		case NPCPROP_GMAPLEVELY:
-			return CString() >> (char)(level && level->getMap() ? level->getMap()->getLevelY(level->getActualLevelName()) : 0);
+			return CString() >> (char)(level ? level->getMapY() : 0);
 
 #ifdef V8NPCSERVER
 		case NPCPROP_SCRIPTER:
@@ -738,6 +738,7 @@ CString TNPC::setProps(CString& pProps, int clientVersion, bool pForward)
 	}
 
 #ifdef V8NPCSERVER
+	updateLevelGrid();
 	if (hasMoved) testTouch();
 #endif
 
@@ -1312,6 +1313,7 @@ void TNPC::warpNPC(TLevel *pLevel, float pX, float pY)
 
 	y = pY;
 	y2 = 16 * pY;
+	updateLevelGrid();
 
 	// Send the properties to the players in the new level
 	server->sendPacketToLevel(CString() >> (char)PLO_NPCPROPS >> (int)id << getProps(0), level->getMap(), level, 0, true);
@@ -1321,6 +1323,15 @@ void TNPC::warpNPC(TLevel *pLevel, float pX, float pY)
 	this->queueNpcAction("npc.warped");
 }
 
+void TNPC::updateLevelGrid()
+{
+#ifdef V8NPCSERVER
+	// Keep the level's NPC lookup grid in sync with our position.
+	if (level != nullptr)
+		level->updateNPCGrid(this);
+#endif
+}
+
 void TNPC::saveNPC()
 {
 	// TODO(joey): check if properties have been modified before deciding to save
@@ -1394,6 +1405,11 @@ bool TNPC::loadNPC(const CString& fileName)
 	if (!fileData.load(fileName))
 		return false;
 
+	return loadNPCData(fileData);
+}
+
+bool TNPC::loadNPCData(CString fileData)
+{
 	fileData.removeAllI("\r");
 
 	CString headerLine = fileData.readString("\n");
@@ -308,17 +308,19 @@ TPlayer::TPlayer(TServer* pServer, CSocket* pSocket, int pId)
 playerSock(pSocket), key(0),
 os("wind"), codepage(1252), level(0),
 id(pId), type(PLTYPE_AWAIT), versionID(CLVER_2_17),
-pmap(0), carryNpcId(0), carryNpcThrown(false), loaded(false),
+pmap(0), cellMap(0), mapCellX(0), mapCellY(0), carryNpcId(0), carryNpcThrown(false), loaded(false),
 nextIsRaw(false), rawPacketSize(0), isFtp(false),
 grMovementUpdated(false),
-fileQueue(pSocket),
-packetCount(0), firstLevel(true), invalidPackets(0)
+fileQueue(pSocket), outDeficit(), outQueued(false), outBacklog(false),
+packetCount(0), firstLevel(true), invalidPackets(0), loginPending(false)
 #ifdef V8NPCSERVER
 , _processRemoval(false), _scriptObject(0)
 #endif
 {
 	lastData = lastMovement = lastSave = last1m = time(0);
 	lastChat = lastMessage = lastNick = 0;
+	sendStatsCount = server->getClientSends();
+	sendStatsSince = std::chrono::steady_clock::now();
 	isExternal = false;
 	serverName = server->getName();
 	externalPlayerIds.resize(16000);
@@ -334,9 +336,17 @@ packetCount(0), firstLevel(true), invalidPackets(0)
 
 TPlayer::~TPlayer()
 {
+	// Make sure no socket worker is still using us.
+	server->getSocketWorkers()->cancel(&inDecoded);
+	server->getSocketWorkers()->cancel(this);
+	server->removeDecodedPlayer(this);
+
 	// Send all unsent data (for disconnect messages and whatnot).
 	if (playerSock)
+	{
+		moveOutgoingToQueue(true);
 		fileQueue.sendCompress();
+	}
 
 	if (id >= 0 && server != 0 && loaded)
 	{
@@ -371,6 +381,9 @@ TPlayer::~TPlayer()
 			serverlog.out("[%s] :: NC disconnected: %s\n", server->getName().text(), accountName.text());
 	}
 
+	// Make sure the map doesn't keep a pointer to us.
+	if (cellMap) cellMap->removePlayer(this);
+
 	// Clean up.
 	for ( auto i = cachedLevels.begin(); i != cachedLevels.end(); )
 	{
@@ -385,6 +398,13 @@ TPlayer::~TPlayer()
 		spLevels.erase(i++);
 	}
 
+	for (auto& transfer : fileTransfers)
+	{
+		if (transfer.file)
+			fclose(transfer.file);
+	}
+	fileTransfers.clear();
+
 	if (playerSock)
 		delete playerSock;
 
@@ -397,36 +417,318 @@ TPlayer::~TPlayer()
 #endif
 }
 
+bool TPlayer::isSocketDisconnected()
+{
+	std::lock_guard<std::mutex> lock(fileQueueLock);
+	return (playerSock == 0 || playerSock->getState() == SOCKET_STATE_DISCONNECTED);
+}
+
 bool TPlayer::onRecv()
 {
-	// If our socket is gone, delete ourself.
-	if (playerSock == 0 || playerSock->getState() == SOCKET_STATE_DISCONNECTED)
-		return false;
+	{
+		// A send worker can disconnect the socket while we read from it.
+		std::lock_guard<std::mutex> lock(fileQueueLock);
 
-	// Grab the data from the socket and put it into our receive buffer.
-	unsigned int size = 0;
-	char* data = playerSock->getData(&size);
-	if (size != 0)
-		rBuffer.write(data, size);
-	else if (playerSock->getState() == SOCKET_STATE_DISCONNECTED)
-		return false;
+		// If our socket is gone, delete ourself.
+		if (playerSock == 0 || playerSock->getState() == SOCKET_STATE_DISCONNECTED)
+			return false;
+
+		// Grab the data from the socket and put it into our receive buffer.
+		unsigned int size = 0;
+		char* data = playerSock->getData(&size);
+		if (size != 0)
+			rBuffer.write(data, size);
+		else if (playerSock->getState() == SOCKET_STATE_DISCONNECTED)
+			return false;
+	}
 
 	// Do the main function.
 	return doMain();
 
 }
 
+bool TPlayer::receiveData(const char* pData, unsigned int pSize)
+{
+	// Parse data that didn't come off our socket, as if onRecv() had read it.
+	rBuffer.write(pData, pSize);
+	return doMain();
+}
+
 bool TPlayer::onSend()
 {
-	if (playerSock == 0 || playerSock->getState() == SOCKET_STATE_DISCONNECTED)
+	if (isSocketDisconnected())
 		return false;
 
+	// Queue more of any file we are sending once the last chunks have gone out.
+	if (!fileTransfers.empty() && isOutLaneEmpty(OUTLANE_BULK))
+		sendFileChunks();
+
+	// Let a worker compress and send it.
+	if (server->getSocketWorkers()->isRunning())
+	{
+		if (!outQueued.exchange(true))
+			server->getSocketWorkers()->queue(this, [this]() { flushOutgoing(); });
+		return true;
+	}
+
 	// Send data.
-	fileQueue.sendCompress();
+	{
+		std::lock_guard<std::mutex> lock(fileQueueLock);
+		if (!fileQueue.canSend())
+			moveOutgoingToQueue();
+
+		CSendCounter counter(isClient() ? server->getClientSendCounter() : nullptr);
+		fileQueue.sendCompress();
+	}
+
+	// More than one flush worth was waiting.  The socket took all of it so
+	// epoll won't tell us, come back for the rest straight away.
+	if (!fileQueue.canSend() && !isOutLanesEmpty())
+		server->getSocketManager()->wakeup();
 
 	return true;
 }
 
+// Returns the movement props in a PLO_OTHERPLPROPS packet, or 0 if it has
+// anything else in it.  Only packets like that can replace each other.
+static unsigned char getMovementProps(const CString& pPacket, short& pPlayerId)
+{
+	const unsigned char* data = (const unsigned char*)pPacket.text();
+	int len = pPacket.length();
+	if (len > 0 && data[len - 1] == '\n')
+		--len;
+	if (len < 4)
+		return 0;
+
+	pPlayerId = (short)(((data[1] - 32) << 7) + (data[2] - 32));
+
+	unsigned char movement = 0;
+	for (int i = 3; i < len; )
+	{
+		int prop = data[i++] - 32;
+		int propLen = 1;
+		unsigned char bit = 0;
+		switch (prop)
+		{
+			case PLPROP_X: bit = 0x01; break;
+			case PLPROP_Y: bit = 0x02; break;
+			case PLPROP_Z: bit = 0x04; break;
+			case PLPROP_SPRITE: bit = 0x08; break;
+			case PLPROP_X2: bit = 0x10; propLen = 2; break;
+			case PLPROP_Y2: bit = 0x20; propLen = 2; break;
+			case PLPROP_Z2: bit = 0x40; propLen = 2; break;
+			default:
+				return 0;
+		}
+
+		if (i + propLen > len)
+			return 0;
+		movement |= bit;
+		i += propLen;
+	}
+	return movement;
+}
+
+void TPlayer::queueOutgoing(const CString& pPacket)
+{
+	// No connection to prioritize for.
+	if (playerSock == nullptr)
+	{
+		fileQueue.addPacket(pPacket);
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(outLock);
+
+	// A PLO_RAWDATA on its own announces the packet after it, so they have to
+	// stay together.  Hold on to it until that packet shows up.
+	unsigned char packetId = (unsigned char)pPacket.text()[0] - 32;
+	if (outRawHeader.isEmpty() && packetId == PLO_RAWDATA && pPacket.find("\n") == pPacket.length() - 1)
+	{
+		outRawHeader = pPacket;
+		return;
+	}
+
+	SOutPacket out;
+	out.header = std::move(outRawHeader);
+	out.packet = pPacket;
+	out.playerId = -1;
+	out.movement = 0;
+	outRawHeader.clear();
+
+	int lane = OUTLANE_NORMAL;
+	switch (packetId)
+	{
+		case PLO_FILE:
+		case PLO_LARGEFILESTART:
+		case PLO_LARGEFILESIZE:
+		case PLO_LARGEFILEEND:
+		case PLO_FILESENDFAILED:
+			lane = OUTLANE_BULK;
+			break;
+
+		case PLO_OTHERPLPROPS:
+			if (out.header.isEmpty())
+				out.movement = getMovementProps(pPacket, out.playerId);
+			if (out.movement != 0)
+				lane = OUTLANE_REALTIME;
+			break;
+	}
+
+	// Packets about a player have to reach the client in order, so movement
+	// can't jump ahead of an add, delete or props packet for the same player
+	// that is still waiting.  Send it behind them instead.
+	if (lane == OUTLANE_REALTIME && outPlayerPackets.find(out.playerId) != outPlayerPackets.end())
+	{
+		out.movement = 0;
+		lane = OUTLANE_NORMAL;
+	}
+
+	if (lane == OUTLANE_NORMAL)
+	{
+		switch (packetId)
+		{
+			case PLO_OTHERPLPROPS:
+			case PLO_ADDPLAYER:
+			case PLO_DELPLAYER:
+				if (pPacket.length() >= 3)
+				{
+					const unsigned char* data = (const unsigned char*)pPacket.text();
+					out.playerId = (short)(((data[1] - 32) << 7) + (data[2] - 32));
+					++outPlayerPackets[out.playerId];
+				}
+				break;
+		}
+	}
+
+	if (lane == OUTLANE_REALTIME)
+	{
+		// If the player hasn't been sent their last position yet, just send the new one in its place.
+		auto it = outMovement.find(out.playerId);
+		if (it != outMovement.end() && (it->second->movement & ~out.movement) == 0)
+		{
+			it->second->packet = std::move(out.packet);
+			it->second->movement = out.movement;
+			return;
+		}
+
+		// Pushing to the back of a deque leaves pointers to the other packets alone.
+		short playerId = out.playerId;
+		outLanes[lane].push_back(std::move(out));
+		outMovement[playerId] = &outLanes[lane].back();
+		return;
+	}
+
+	outLanes[lane].push_back(std::move(out));
+}
+
+bool TPlayer::isOutLaneEmpty(int pLane)
+{
+	std::lock_guard<std::mutex> lock(outLock);
+	return outLanes[pLane].empty();
+}
+
+bool TPlayer::isOutLanesEmpty()
+{
+	std::lock_guard<std::mutex> lock(outLock);
+	for (const auto& lane : outLanes)
+	{
+		if (!lane.empty())
+			return false;
+	}
+	return true;
+}
+
+void TPlayer::moveOutgoingToQueue(bool pAll)
+{
+	// Caller must hold fileQueueLock, or know no worker can be running.
+	static const int outLaneWeights[OUTLANE_COUNT] = { 4, 2, 1 };
+
+	std::vector<CString> packets;
+	{
+		std::lock_guard<std::mutex> lock(outLock);
+
+		// Deficit round robin.  Every round, each lane with packets waiting can
+		// move its weight in quanta, so file transfers can't hold up movement
+		// and movement can't starve file transfers.
+		int moved = 0;
+		bool waiting = true;
+		while (waiting && (pAll || moved < OUTLANE_BUDGET))
+		{
+			waiting = false;
+			for (int lane = 0; lane < OUTLANE_COUNT; ++lane)
+			{
+				std::deque<SOutPacket>& queue = outLanes[lane];
+				if (queue.empty())
+					continue;
+
+				outDeficit[lane] += outLaneWeights[lane] * OUTLANE_QUANTUM;
+				while (!queue.empty())
+				{
+					SOutPacket& out = queue.front();
+					int size = out.header.length() + out.packet.length();
+					if (size > outDeficit[lane] && !pAll)
+						break;
+
+					if (lane == OUTLANE_REALTIME)
+					{
+						auto it = outMovement.find(out.playerId);
+						if (it != outMovement.end() && it->second == &out)
+							outMovement.erase(it);
+					}
+					else if (lane == OUTLANE_NORMAL && out.playerId != -1)
+					{
+						auto it = outPlayerPackets.find(out.playerId);
+						if (it != outPlayerPackets.end() && --it->second <= 0)
+							outPlayerPackets.erase(it);
+					}
+
+					// The lane is done with it, so take the data instead of copying it.
+					if (!out.header.isEmpty())
+						packets.push_back(std::move(out.header));
+					packets.push_back(std::move(out.packet));
+					outDeficit[lane] -= size;
+					moved += size;
+					queue.pop_front();
+				}
+
+				// An idle lane doesn't get to save up.
+				if (queue.empty())
+					outDeficit[lane] = 0;
+				else waiting = true;
+			}
+		}
+	}
+
+	for (const auto& packet : packets)
+		fileQueue.addPacket(packet);
+}
+
+void TPlayer::flushOutgoing()
+{
+	// Runs on a send worker.  Packets queued after this point get a new flush.
+	outQueued = false;
+
+	std::lock_guard<std::mutex> lock(fileQueueLock);
+	if (!fileQueue.canSend())
+		moveOutgoingToQueue();
+	{
+		CSendCounter counter(isClient() ? server->getClientSendCounter() : nullptr);
+		fileQueue.sendCompress();
+	}
+	outBacklog = fileQueue.canSend();
+
+	// The server thread only flushes again when it wakes up.  If the budget
+	// left packets in the lanes, wake it now instead of at the next tick.
+	// Anything left in the file queue is waiting on a full socket, and epoll
+	// will report that when it drains.
+	if (!outBacklog && !isOutLanesEmpty())
+	{
+		server->getSocketManager()->markDirty(this);
+		server->getSocketManager()->wakeup();
+	}
+}
+
 void TPlayer::onUnregister()
 {
 	// Called when onSend() or onRecv() returns false.
@@ -435,12 +737,21 @@ void TPlayer::onUnregister()
 
 bool TPlayer::canRecv()
 {
-	if (playerSock->getState() == SOCKET_STATE_DISCONNECTED) return false;
+	if (isSocketDisconnected()) return false;
 	return true;
 }
 
 bool TPlayer::canSend()
 {
+	if (!fileTransfers.empty())
+		return true;
+
+	if (!isOutLanesEmpty())
+		return true;
+
+	if (playerSock != nullptr && server->getSocketWorkers()->isRunning())
+		return outBacklog;
+
 	return fileQueue.canSend();
 }
 
@@ -452,47 +763,138 @@ bool TPlayer::doMain()
 	// definitions
 	CString unBuffer;
 
+	// Once logged in the codec won't change anymore, so the frames can be
+	// decoded on a socket worker while we get on with other things.
+	CWorkerPool* workers = server->getSocketWorkers();
+	std::vector<CString> frames;
+
 	// parse data
-	rBuffer.setRead(0);
-	while (rBuffer.length() > 1)
+	// Walk the buffer with a read offset and only drop the consumed bytes once
+	// we are done, instead of shifting the whole buffer after every packet.
+	unsigned int readPos = 0;
+	while ((unsigned int)rBuffer.length() - readPos > 1)
 	{
 		// New data.
 		lastData = time(0);
 
 		// packet length
+		rBuffer.setRead(readPos);
 		unsigned short len = (unsigned short)rBuffer.readShort();
-		if ((unsigned int)len > (unsigned int)rBuffer.length()-2)
+		if ((unsigned int)len > (unsigned int)rBuffer.length() - readPos - 2)
 			break;
 
 		// get packet
 		unBuffer = rBuffer.readChars(len);
-		rBuffer.removeI(0, len+2);
+		readPos += len + 2;
+
+		// Frames behind a pending login have to queue up behind it as well.
+		if (workers->isRunning() && (isLoggedIn() || loginPending))
+		{
+			frames.push_back(unBuffer);
+			continue;
+		}
 
 		// decrypt packet
-		switch (in_codec.getGen())
+		decodeFrame(unBuffer);
+
+		// well theres your buffer
+		if (!parsePacket(unBuffer))
 		{
-			case ENCRYPT_GEN_1:		// Gen 1 is not encrypted or compressed.
-				break;
+			rBuffer.removeI(0, readPos);
+			return false;
+		}
+	}
 
-			// Gen 2 and 3 are zlib compressed.  Gen 3 encrypts individual packets
-			// Uncompress so we can properly decrypt later on.
-			case ENCRYPT_GEN_2:
-			case ENCRYPT_GEN_3:
-				unBuffer.zuncompressI();
-				break;
+	// Remove the processed packets, leaving any partial packet at the front.
+	if (readPos > 0)
+		rBuffer.removeI(0, readPos);
 
-			// Gen 4 and up encrypt the whole combined and compressed packet.
-			// Decrypt and decompress.
-			default:
-				decryptPacket(unBuffer);
-				break;
+	// Hand the frames off.  They get parsed in parseDecoded() once they are ready.
+	if (!frames.empty())
+	{
+		auto job = std::make_shared<std::vector<CString> >(std::move(frames));
+		workers->queue(&inDecoded, [this, job]() { decodeFrames(*job); });
+		return true;
+	}
+
+	finishParsing();
+	return true;
+}
+
+void TPlayer::decodeFrame(CString& pFrame)
+{
+	switch (in_codec.getGen())
+	{
+		case ENCRYPT_GEN_1:		// Gen 1 is not encrypted or compressed.
+			break;
+
+		// Gen 2 and 3 are zlib compressed.  Gen 3 encrypts individual packets
+		// Uncompress so we can properly decrypt later on.
+		case ENCRYPT_GEN_2:
+		case ENCRYPT_GEN_3:
+			pFrame.zuncompressI();
+			break;
+
+		// Gen 4 and up encrypt the whole combined and compressed packet.
+		// Decrypt and decompress.
+		default:
+			decryptPacket(pFrame);
+			break;
+	}
+}
+
+void TPlayer::decodeFrames(std::vector<CString>& pFrames)
+{
+	// Runs on a socket worker.  Frames for a player are decoded one batch at a
+	// time and in order, so the codec sees them the same way doMain() would.
+	for (auto& frame : pFrames)
+		decodeFrame(frame);
+
+	{
+		std::lock_guard<std::mutex> lock(inLock);
+		for (auto& frame : pFrames)
+			inDecoded.push_back(std::move(frame));
+	}
+	server->addDecodedPlayer(this);
+}
+
+bool TPlayer::parseDecoded()
+{
+	std::vector<CString> packets;
+	std::shared_ptr<SAccountLoad> load;
+	{
+		std::lock_guard<std::mutex> lock(inLock);
+
+		// Nothing gets parsed until we have our account.
+		if (loginPending && !accountLoad)
+			return true;
+
+		load.swap(accountLoad);
+		packets.swap(inDecoded);
+	}
+
+	if (load)
+	{
+		loginPending = false;
+		if (!finishLogin(load->fileData, load->loadedFromDefault))
+		{
+			setId(0);	// Prevent saving of the account.
+			return false;
 		}
+	}
 
-		// well theres your buffer
-		if (!parsePacket(unBuffer))
+	for (auto& packet : packets)
+	{
+		if (!parsePacket(packet))
 			return false;
 	}
 
+	finishParsing();
+	return true;
+}
+
+void TPlayer::finishParsing()
+{
 	// Update the -gr_movement packets.
 	if (!grMovementPackets.isEmpty())
 	{
@@ -505,9 +907,6 @@ bool TPlayer::doMain()
 		grMovementPackets.clear(42);
 	}
 	grMovementUpdated = false;
-
-	server->getSocketManager()->updateSingle(this, false, true);
-	return true;
 }
 
 bool TPlayer::doTimedEvents()
@@ -515,7 +914,7 @@ bool TPlayer::doTimedEvents()
 	time_t currTime = time(0);
 
 	// If we are disconnected, delete ourself!
-	if (playerSock == 0 || playerSock->getState() == SOCKET_STATE_DISCONNECTED)
+	if (isSocketDisconnected())
 	{
 		server->deletePlayer(this);
 		return false;
@@ -568,16 +967,6 @@ bool TPlayer::doTimedEvents()
 		}
 	}
 
-	// Do singleplayer level events.
-	{
-		for (auto& spLevel : spLevels)
-		{
-			TLevel* level = spLevel.second;
-			if (level)
-				level->doTimedEvents();
-		}
-	}
-
 	// Save player account every 5 minutes.
 	if ((int)difftime(currTime, lastSave) > 300)
 	{
@@ -609,6 +998,18 @@ bool TPlayer::parsePacket(CString& pPacket)
 		packetCount++;
 		if ( !msgPLI_LOGIN(CString() << pPacket.readString("\n")))
 			return false;
+
+		// The account is still being read.  The rest of the frame has to wait
+		// for finishLogin(), ahead of anything that came in after it.
+		if (loginPending)
+		{
+			if (pPacket.bytesLeft() > 0)
+			{
+				std::lock_guard<std::mutex> lock(inLock);
+				inDecoded.insert(inDecoded.begin(), pPacket.readChars(pPacket.bytesLeft()));
+			}
+			return true;
+		}
 	}
 
 	while (pPacket.bytesLeft() > 0)
@@ -703,21 +1104,29 @@ void TPlayer::decryptPacket(CString& pPacket)
 	}
 }
 
-void TPlayer::sendPacket(CString pPacket, bool appendNL)
+void TPlayer::sendPacket(const CString& pPacket, bool appendNL)
 {
 	// empty buffer?
 	if (pPacket.isEmpty())
 		return;
 
 	// append '\n'
-	if (appendNL)
+	// Broadcasts come in already terminated, so the queue is the only copy.
+	if (appendNL && pPacket.text()[pPacket.length()-1] != '\n')
 	{
-		if (pPacket[pPacket.length()-1] != '\n')
-			pPacket.writeChar('\n');
+		CString packet(pPacket);
+		packet.writeChar('\n');
+		queueOutgoing(packet);
+	}
+	else
+	{
+		// append buffer
+		queueOutgoing(pPacket);
 	}
 
-	// append buffer
-	fileQueue.addPacket(pPacket);
+	// Have the reactor flush us at the end of the tick.
+	if (playerSock != nullptr)
+		server->getSocketManager()->markDirty(this);
 }
 
 bool TPlayer::sendFile(const CString& pFile)
@@ -744,38 +1153,29 @@ bool TPlayer::sendFile(const CString& pFile)
 bool TPlayer::sendFile(const CString& pPath, const CString& pFile)
 {
 	CString filepath = CString() << server->getServerPath() << pPath << pFile;
-	CString fileData;
-	fileData.load(filepath);
-
-	time_t modTime = 0;
-	struct stat fileStat;
-	if (stat(filepath.text(), &fileStat) != -1)
-		modTime = fileStat.st_mtime;
 
 	// See if the file exists.
-	if (fileData.length() == 0)
+	struct stat fileStat;
+	if (stat(filepath.text(), &fileStat) == -1 || fileStat.st_size == 0)
 	{
 		sendPacket(CString() >> (char)PLO_FILESENDFAILED << pFile);
 		return false;
 	}
 
+	long long fileSize = (long long)fileStat.st_size;
+
 	// Warn for very large files.  These are the cause of many bug reports.
-	if (fileData.length() > 3145728)	// 3MB
+	if (fileSize > 3145728)	// 3MB
 		serverlog.out("[%s] [WARNING] Sending a large file (over 3MB): %s\n", server->getName().text(), pFile.text());
 
 	// See if we have enough room in the packet for the file.
 	// If not, we need to send it as a big file.
-	// 1 (PLO_FILE) + 5 (modTime) + 1 (file.length()) + file.length() + 1 (\n)
-	bool isBigFile = false;
-	int packetLength = 1 + 5 + 1 + pFile.length() + 1;
-	if (fileData.length() > 32000)
-		isBigFile = true;
+	bool isBigFile = (fileSize > FILESEND_CHUNKSIZE);
 
 	// Clients before 2.14 didn't support large files.
 	if (isClient() && versionID < CLVER_2_14)
 	{
-		if (versionID < CLVER_2_1) packetLength -= 5;	// modTime isn't sent.
-		if (fileData.length() > 64000)
+		if (fileSize > 64000)
 		{
 			sendPacket(CString() >> (char)PLO_FILESENDFAILED << pFile);
 			return false;
@@ -783,39 +1183,123 @@ bool TPlayer::sendFile(const CString& pPath, const CString& pFile)
 		isBigFile = false;
 	}
 
-	// If we are sending a big file, let the client know now.
-	if (isBigFile)
-	{
-		sendPacket(CString() >> (char)PLO_LARGEFILESTART << pFile);
-		sendPacket(CString() >> (char)PLO_LARGEFILESIZE >> (long long)fileData.length());
-	}
+	// Commonly requested files come out of the shared file cache.  Anything else
+	// is read off disk a few chunks at a time as the send queue drains.
+	SFileTransfer transfer;
+	transfer.path = filepath;
+	transfer.name = pFile;
+	transfer.cached = CFileCache::shared().get(filepath, fileStat.st_mtime, fileSize);
+	transfer.file = nullptr;
+	transfer.size = (transfer.cached ? transfer.cached->size : fileSize);
+	transfer.offset = 0;
+	transfer.modTime = fileStat.st_mtime;
+	transfer.isBigFile = isBigFile;
+	fileTransfers.push_back(transfer);
+
+	sendFileChunks();
+	return true;
+}
 
-	// Send the file now.
-	while (fileData.length() != 0)
+void TPlayer::sendFileChunks()
+{
+	std::vector<char> buffer;
+	int queued = 0;
+
+	while (!fileTransfers.empty() && queued < FILESEND_WINDOW)
 	{
-		int sendSize = clip(32000, 0, fileData.length());
-		if (isClient() && versionID < CLVER_2_14) sendSize = fileData.length();
+		SFileTransfer& transfer = fileTransfers.front();
 
-		// Older client versions didn't send the modTime.
-		if (isClient() && versionID < CLVER_2_1)
+		// Start sending the file.
+		if (transfer.offset == 0 && transfer.file == nullptr)
 		{
-			// We don't add a \n to the end of the packet, so subtract 1 from the packet length.
-			sendPacket(CString() >> (char)PLO_RAWDATA >> (int)(packetLength - 1 + sendSize));
-			sendPacket(CString() >> (char)PLO_FILE >> (char)pFile.length() << pFile << fileData.subString(0, sendSize), false);
+			if (!transfer.cached)
+				transfer.file = fopen(transfer.path.text(), "rb");
+			if (!transfer.cached && transfer.file == nullptr)
+			{
+				sendPacket(CString() >> (char)PLO_FILESENDFAILED << transfer.name);
+				fileTransfers.pop_front();
+				continue;
+			}
+
+			// If we are sending a big file, let the client know now.
+			if (transfer.isBigFile)
+			{
+				sendPacket(CString() >> (char)PLO_LARGEFILESTART << transfer.name);
+				sendPacket(CString() >> (char)PLO_LARGEFILESIZE >> (long long)transfer.size);
+			}
 		}
-		else
+
+		// Old clients get the whole file in one packet.
+		long long remaining = transfer.size - transfer.offset;
+		int sendSize = (remaining > FILESEND_CHUNKSIZE ? FILESEND_CHUNKSIZE : (int)remaining);
+		if (isClient() && versionID < CLVER_2_14) sendSize = (int)remaining;
+
+		// Cached files keep their chunks framed, so every download after the
+		// first one queues the same packets.
+		std::shared_ptr<const SCachedChunk> framed;
+		if (transfer.cached && sendSize > 0 && transfer.offset % FILESEND_CHUNKSIZE == 0 && !(isClient() && versionID < CLVER_2_14))
+			framed = CFileCache::shared().getChunk(transfer.cached, (size_t)(transfer.offset / FILESEND_CHUNKSIZE), transfer.name);
+
+		const char* chunk = nullptr;
+		if (transfer.cached)
+			chunk = transfer.cached->data.text() + transfer.offset;
+		else if (sendSize > 0)
 		{
-			sendPacket(CString() >> (char)PLO_RAWDATA >> (int)(packetLength + sendSize));
-			sendPacket(CString() >> (char)PLO_FILE >> (long long)modTime >> (char)pFile.length() << pFile << fileData.subString(0, sendSize) << "\n", false);
+			buffer.resize(sendSize);
+			sendSize = (int)fread(buffer.data(), 1, sendSize, transfer.file);
+			chunk = buffer.data();
 		}
 
-		fileData.removeI(0, sendSize);
-	}
+		if (framed)
+		{
+			sendPacket(framed->header);
+			sendPacket(framed->packet, false);
+			transfer.offset += sendSize;
+			++queued;
+		}
+		else if (sendSize > 0)
+		{
+			// 1 (PLO_FILE) + 5 (modTime) + 1 (file.length()) + file.length() + 1 (\n)
+			int packetLength = 1 + 5 + 1 + transfer.name.length() + 1;
 
-	// If we had sent a large file, let the client know we finished sending it.
-	if (isBigFile) sendPacket(CString() >> (char)PLO_LARGEFILEEND << pFile);
+			// Older client versions didn't send the modTime.
+			if (isClient() && versionID < CLVER_2_1)
+			{
+				// We don't add a \n to the end of the packet, so subtract 1 from the packet length.
+				packetLength -= 5;
+				sendPacket(CString() >> (char)PLO_RAWDATA >> (int)(packetLength - 1 + sendSize));
+
+				CString packet;
+				packet >> (char)PLO_FILE >> (char)transfer.name.length() << transfer.name;
+				packet.write(chunk, sendSize);
+				sendPacket(packet, false);
+			}
+			else
+			{
+				sendPacket(CString() >> (char)PLO_RAWDATA >> (int)(packetLength + sendSize));
 
-	return true;
+				CString packet;
+				packet >> (char)PLO_FILE >> (long long)transfer.modTime >> (char)transfer.name.length() << transfer.name;
+				packet.write(chunk, sendSize);
+				packet << "\n";
+				sendPacket(packet, false);
+			}
+
+			transfer.offset += sendSize;
+			++queued;
+		}
+
+		// Done, or the file got shorter while we were sending it.
+		if (sendSize <= 0 || transfer.offset >= transfer.size)
+		{
+			// If we had sent a large file, let the client know we finished sending it.
+			if (transfer.isBigFile) sendPacket(CString() >> (char)PLO_LARGEFILEEND << transfer.name);
+
+			if (transfer.file)
+				fclose(transfer.file);
+			fileTransfers.pop_front();
+		}
+	}
 }
 
 bool TPlayer::testSign()
@@ -826,7 +1310,7 @@ bool TPlayer::testSign()
 	// Check for sign collisions.
 	if ((sprite % 4) == 0)
 	{
-		std::vector<TLevelSign>& signs = level->getLevelSigns();
+		const std::vector<TLevelSign>& signs = level->getLevelSigns();
 		for (const auto& sign : signs)
 		{
 			float signLoc[] = {(float)sign.getX(), (float)sign.getY()};
@@ -1557,6 +2041,9 @@ bool TPlayer::setLevel(const CString& pLevelName, time_t modTime)
 			sendPacket(CString() >> (char)PLO_PLAYERWARP >> (char)(x * 2) >> (char)(y * 2) << levelName);
 	}
 
+	// Move into our new map cell.
+	updateMapCell();
+
 	// Send the level now.
 	bool succeed = true;
 	if (versionID >= CLVER_2_1)
@@ -1609,13 +2096,13 @@ bool TPlayer::sendLevel(TLevel* pLevel, time_t modTime, bool fromAdjacent)
 		if (modTime != pLevel->getModTime())
 		{
 			sendPacket(CString() >> (char)PLO_RAWDATA >> (int)(1+(64*64*2)+1));
-			sendPacket(CString() << pLevel->getBoardPacket());
+			sendPacket(pLevel->getBoardPacket());
 		}
 
 		// Send links, signs, and mod time.
 		sendPacket(CString() >> (char)PLO_LEVELMODTIME >> (long long)pLevel->getModTime());
-		sendPacket(CString() << pLevel->getLinksPacket());
-		sendPacket(CString() << pLevel->getSignsPacket(this));
+		sendPacket(pLevel->getLinksPacket());
+		sendPacket(pLevel->getSignsPacket(this));
 	}
 
 	// Send board changes, chests, horses, and baddies.
@@ -1623,8 +2110,8 @@ bool TPlayer::sendLevel(TLevel* pLevel, time_t modTime, bool fromAdjacent)
 	{
 		sendPacket(CString() << pLevel->getBoardChangesPacket(l_time));
 		sendPacket(CString() << pLevel->getChestPacket(this));
-		sendPacket(CString() << pLevel->getHorsePacket());
-		sendPacket(CString() << pLevel->getBaddyPacket(versionID));
+		sendPacket(pLevel->getHorsePacket());
+		sendPacket(pLevel->getBaddyPacket(versionID));
 	}
 
 	// If we are on a gmap, change our level back to the gmap.
@@ -1680,27 +2167,35 @@ bool TPlayer::sendLevel(TLevel* pLevel, time_t modTime, bool fromAdjacent)
 		if (pmap)
 		{
 			server->sendPacketToLevel(this->getProps(__getLogin, sizeof(__getLogin)/sizeof(bool)), pmap, this, false);
-			std::vector<TPlayer*>* playerList = server->getPlayerList();
-			for (std::vector<TPlayer*>::iterator i = playerList->begin(); i != playerList->end(); ++i)
+
+			// Get the props of everybody in the surrounding map cells.
+			int sgmap[2];
+			if (pmap->getType() == MAPTYPE_GMAP)
 			{
-				TPlayer* player = (TPlayer*)*i;
-				if (player == 0) continue;
-				if (player == this || player->getMap() != pmap) continue;
-				if (pmap->isGroupMap() && levelGroup != player->getGroup()) continue;
+				sgmap[0] = (unsigned char)gmaplevelx;
+				sgmap[1] = (unsigned char)gmaplevely;
+			}
+			else
+			{
+				sgmap[0] = pmap->getLevelX(pLevel->getActualLevelName());
+				sgmap[1] = pmap->getLevelY(pLevel->getActualLevelName());
+			}
 
-				if (pmap->getType() == MAPTYPE_GMAP)
-				{
-					int ogmap[2] = {player->getProp(PLPROP_GMAPLEVELX).readGUChar(), player->getProp(PLPROP_GMAPLEVELY).readGUChar()};
-					if (abs(ogmap[0] - gmaplevelx) < 2 && abs(ogmap[1] - gmaplevely) < 2)
-						this->sendPacket(player->getProps(__getLogin, sizeof(__getLogin)/sizeof(bool)));
-				}
-				else if (pmap->getType() == MAPTYPE_BIGMAP)
+			for (int cy = sgmap[1] - 1; cy <= sgmap[1] + 1; ++cy)
+			{
+				for (int cx = sgmap[0] - 1; cx <= sgmap[0] + 1; ++cx)
 				{
-					if (player->getLevel() == 0) continue;
-					int ogmap[2] = {pmap->getLevelX(player->getLevel()->getActualLevelName()), pmap->getLevelY(player->getLevel()->getActualLevelName())};
-					int sgmap[2] = {pmap->getLevelX(pLevel->getActualLevelName()), pmap->getLevelY(pLevel->getActualLevelName())};
-					if (abs(ogmap[0] - sgmap[0]) < 2 && abs(ogmap[1] - sgmap[1]) < 2)
+					const std::vector<TPlayer*>* cell = pmap->getPlayersAt(cx, cy);
+					if (cell == 0) continue;
+
+					for (auto player : *cell)
+					{
+						if (player == this || player->getMap() != pmap) continue;
+						if (player->getLevel() == 0) continue;
+						if (pmap->isGroupMap() && levelGroup != player->getGroup()) continue;
+
 						this->sendPacket(player->getProps(__getLogin, sizeof(__getLogin)/sizeof(bool)));
+					}
 				}
 			}
 		}
@@ -1736,7 +2231,7 @@ bool TPlayer::sendLevel141(TLevel* pLevel, time_t modTime, bool fromAdjacent)
 		if (modTime != pLevel->getModTime())
 		{
 			sendPacket(CString() >> (char)PLO_RAWDATA >> (int)(1+(64*64*2)+1));
-			sendPacket(CString() << pLevel->getBoardPacket());
+			sendPacket(pLevel->getBoardPacket());
 
 			if (firstLevel)
 				sendPacket(CString() >> (char)PLO_LEVELNAME << pLevel->getLevelName());
@@ -1745,8 +2240,8 @@ bool TPlayer::sendLevel141(TLevel* pLevel, time_t modTime, bool fromAdjacent)
 			// Send links, signs, and mod time.
 			if ( !settings->getBool("serverside", false))	// TODO: NPC server check instead.
 			{
-				sendPacket(CString() << pLevel->getLinksPacket());
-				sendPacket(CString() << pLevel->getSignsPacket(this));
+				sendPacket(pLevel->getLinksPacket());
+				sendPacket(pLevel->getSignsPacket(this));
 			}
 			sendPacket(CString() >> (char)PLO_LEVELMODTIME >> (long long)pLevel->getModTime());
 		}
@@ -1763,8 +2258,8 @@ bool TPlayer::sendLevel141(TLevel* pLevel, time_t modTime, bool fromAdjacent)
 	// Send board changes, chests, horses, and baddies.
 	if ( !fromAdjacent )
 	{
-		sendPacket(CString() << pLevel->getHorsePacket());
-		sendPacket(CString() << pLevel->getBaddyPacket(versionID));
+		sendPacket(pLevel->getHorsePacket());
+		sendPacket(pLevel->getBaddyPacket(versionID));
 	}
 
 	// Tell the client if there are any ghost players in the level.
@@ -1834,22 +2329,58 @@ bool TPlayer::leaveLevel(bool resetCache)
 	{
 		server->sendPacketToLevel(this->getProps(0, 0) >> (char)PLPROP_JOINLEAVELVL >> (char)0, 0, level, this);
 
-		std::vector<TPlayer*>* playerList = server->getPlayerList();
+		std::vector<TPlayer*>* playerList = level->getPlayerList();
 		for (std::vector<TPlayer*>::iterator i = playerList->begin(); i != playerList->end(); ++i)
 		{
 			TPlayer* player = (TPlayer*)*i;
 			if (player == this) continue;
-			if (player->getLevel() != level) continue;
 			this->sendPacket(player->getProps(0, 0) >> (char)PLPROP_JOINLEAVELVL >> (char)0);
 		}
 	}
 
 	// Set the level pointer to 0.
 	level = 0;
+	updateMapCell();
 
 	return true;
 }
 
+void TPlayer::setMap(TMap* map)
+{
+	pmap = map;
+	updateMapCell();
+}
+
+void TPlayer::updateMapCell()
+{
+	// Only clients that are on a level of a map get a cell.
+	TMap* newMap = (level != 0 && isClient() ? pmap : 0);
+	if (cellMap != 0 && cellMap != newMap)
+		cellMap->removePlayer(this);
+
+	cellMap = newMap;
+	if (cellMap == 0)
+		return;
+
+	// Gmaps use the position the client reports, bigmaps use the level position.
+	if (cellMap->getType() == MAPTYPE_GMAP)
+	{
+		mapCellX = (unsigned char)gmaplevelx;
+		mapCellY = (unsigned char)gmaplevely;
+	}
+	else if (level->getMap() == cellMap)
+	{
+		mapCellX = level->getMapX();
+		mapCellY = level->getMapY();
+	}
+	else
+	{
+		mapCellX = cellMap->getLevelX(level->getActualLevelName());
+		mapCellY = cellMap->getLevelY(level->getActualLevelName());
+	}
+	cellMap->setPlayerCell(this, mapCellX, mapCellY);
+}
+
 time_t TPlayer::getCachedLevelModTime(const TLevel* level) const
 {
 	for (std::vector<SCachedLevel*>::const_iterator i = cachedLevels.begin(); i != cachedLevels.end(); ++i)
@@ -2233,7 +2764,12 @@ bool TPlayer::msgPLI_LOGIN(CString& pPacket)
 		key = (unsigned char)pPacket.readGChar();
 		in_codec.reset(key);
 		if (in_codec.getGen() > ENCRYPT_GEN_3)
+		{
+			// Anything already queued goes out with the new codec, same as without workers.
+			std::lock_guard<std::mutex> lock(fileQueueLock);
+			moveOutgoingToQueue(true);
 			fileQueue.setCodec(in_codec.getGen(), key);
+		}
 	}
 
 	// Read Client-Version
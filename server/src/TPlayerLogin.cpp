@@ -42,9 +42,37 @@ CString _zlibFix(
 	TPlayer: Manage Account
 */
 bool TPlayer::sendLogin()
+{
+	// Read the account on a socket worker so a login storm doesn't hold up
+	// everyone else.  parseDecoded() finishes the login once it's back.
+	CWorkerPool* workers = server->getSocketWorkers();
+	if (workers->isRunning() && playerSock != nullptr)
+	{
+		loginPending = true;
+		CString account(accountName);
+		workers->queue(&inDecoded, [this, account]()
+		{
+			auto load = std::make_shared<SAccountLoad>();
+			TAccount::readAccountFile(server, account, load->fileData, load->loadedFromDefault);
+			{
+				std::lock_guard<std::mutex> lock(inLock);
+				accountLoad = load;
+			}
+			server->addDecodedPlayer(this);
+		});
+		return true;
+	}
+
+	std::vector<CString> accountData;
+	bool loadedFromDefault;
+	TAccount::readAccountFile(server, accountName, accountData, loadedFromDefault);
+	return finishLogin(accountData, loadedFromDefault);
+}
+
+bool TPlayer::finishLogin(std::vector<CString>& pAccountData, bool pLoadedFromDefault)
 {
 	// We don't need to check if this fails.. because the defaults have already been loaded :)
-	loadAccount(accountName, (isRC() || isNC() ? true : false));
+	parseAccount(accountName, pAccountData, pLoadedFromDefault, (isRC() || isNC() ? true : false));
 
 	// Check to see if the player is banned or not.
 	if (isBanned && !hasRight(PLPERM_MODIFYSTAFFACCOUNT))
@@ -333,7 +361,6 @@ bool TPlayer::sendLoginClient()
 	sendPacket(CString() >> (char)PLO_UNKNOWN190);
 
 	// Send the level to the player.
-	// warp will call sendCompress() for us.
 	bool warpSuccess = warp(levelName, x, y);
 	if (!warpSuccess && level == 0)
 	{
@@ -13,6 +13,7 @@
 
 #include "TServer.h"
 #include "TPlayer.h"
+#include "CFileCache.h"
 #include "IEnums.h"
 #include "TLevel.h"
 
@@ -634,7 +635,8 @@ bool TPlayer::msgPLI_RC_ACCOUNTLISTGET(CString& pPacket)
 
 	// Search through all the accounts.
 	CFileSystem* fs = server->getAccountsFileSystem();
-	for (std::map<CString, CString>::iterator i = fs->getFileList().begin(); i != fs->getFileList().end(); ++i)
+	auto fileList = fs->getFileList();
+	for (std::map<CString, CString>::const_iterator i = fileList->begin(); i != fileList->end(); ++i)
 	{
 		CString acc = removeExtension(i->first);
 		if (acc.isEmpty()) continue;
@@ -1091,6 +1093,39 @@ bool TPlayer::msgPLI_RC_CHAT(CString& pPacket)
 			rclog.out("%s reloaded the weapons.\n", accountName.text());
 			server->loadWeapons(true);
 		}
+		else if (words[0] == "/filecache" && words.size() == 1)
+		{
+			SFileCacheStats stats = CFileCache::shared().getStats();
+			unsigned long long requests = stats.hits + stats.misses;
+			sendPacket(CString() >> (char)PLO_RC_CHAT << "File cache: " << CString((unsigned int)stats.files) << " files, "
+				<< CString((unsigned int)(stats.bytes / 1024)) << " / " << CString((unsigned int)(stats.byteLimit / 1024)) << " KB");
+			sendPacket(CString() >> (char)PLO_RC_CHAT << "File cache: " << CString((unsigned int)stats.hits) << " hits, "
+				<< CString((unsigned int)stats.misses) << " misses, " << CString((unsigned int)stats.evictions) << " evictions ("
+				<< CString((unsigned int)(requests ? stats.hits * 100 / requests : 0)) << "% hit rate)");
+		}
+		else if (words[0] == "/sendstats" && words.size() == 1)
+		{
+			// Counts since our last /sendstats, or since we logged in.
+			auto now = std::chrono::steady_clock::now();
+			unsigned long long total = server->getClientSends();
+			unsigned long long sends = total - sendStatsCount;
+			double seconds = std::chrono::duration<double>(now - sendStatsSince).count();
+			sendStatsCount = total;
+			sendStatsSince = now;
+
+			// Only game clients are counted, so leave RCs and NCs out of the average.
+			unsigned int clients = 0;
+			for (auto player : *server->getPlayerList())
+			{
+				if (player->isClient())
+					++clients;
+			}
+
+			char rate[32];
+			sprintf(rate, "%.2f", (seconds > 0 && clients > 0 ? sends / seconds / clients : 0.0));
+			sendPacket(CString() >> (char)PLO_RC_CHAT << "Sends: " << CString((unsigned int)sends) << " send() calls in " << CString((unsigned int)seconds) << " seconds, "
+				<< rate << " per client per second (" << CString(clients) << " clients)");
+		}
 #ifdef V8NPCSERVER
 		else if (words[0] == "/savenpcs" && words.size() == 1)
 		{
@@ -1126,7 +1161,7 @@ bool TPlayer::msgPLI_RC_CHAT(CString& pPacket)
 			// Search for the files.
 			for (unsigned int i = 0; i < FS_COUNT; ++i)
 			{
-				auto& fileList = server->getFileSystem(i)->getFileList();
+				auto fileList = server->getFileSystem(i)->getFileList();
 				CString fs("none");
 				if (i == 0) fs = "all";
 				if (i == 1) fs = "file";
@@ -1136,7 +1171,7 @@ bool TPlayer::msgPLI_RC_CHAT(CString& pPacket)
 				if (i == 5) fs = "sword";
 				if (i == 6) fs = "shield";
 
-				for (std::map<CString, CString>::const_iterator i = fileList.begin(); i != fileList.end(); ++i)
+				for (std::map<CString, CString>::const_iterator i = fileList->begin(); i != fileList->end(); ++i)
 				{
 					if (i->first.match(search))
 						found[i->second.removeAll(server->getServerPath())] = fs;
@@ -1566,7 +1601,8 @@ bool TPlayer::msgPLI_RC_FILEBROWSER_START(CString& pPacket)
 		CString rights = (*i).readString(":");
 		CString wildcard = (*i).readString("");
 		(*i).setRead(0);
-		for (std::map<CString, CString>::iterator j = fs.getFileList().begin(); j != fs.getFileList().end(); ++j)
+		auto fileList = fs.getFileList();
+		for (std::map<CString, CString>::const_iterator j = fileList->begin(); j != fileList->end(); ++j)
 		{
 			// See if the file matches the wildcard.
 			if (!j->first.match(wildcard))
@@ -1656,7 +1692,8 @@ bool TPlayer::msgPLI_RC_FILEBROWSER_CD(CString& pPacket)
 		CString rights = (*i).readString(":");
 		CString wildcard = (*i).readString("");
 		(*i).setRead(0);
-		for (std::map<CString, CString>::iterator j = fs.getFileList().begin(); j != fs.getFileList().end(); ++j)
+		auto fileList = fs.getFileList();
+		for (std::map<CString, CString>::const_iterator j = fileList->begin(); j != fileList->end(); ++j)
 		{
 			// See if the file matches the wildcard.
 			if (!j->first.match(wildcard))
@@ -2164,6 +2201,7 @@ void updateFile(TPlayer* player, TServer* server, CString& dir, CString& file)
 	// TODO: Should combine all server options loading/saving into one function in TServer.
 	if (ext == ".nw" || ext == ".graal" || ext == ".zelda")
 	{
+		server->getMissingLevels()->erase(std::string(file.toLower().text()));
 		TLevel* l = TLevel::findLevel(file, server);
 		if (l) l->reload();
 	}
@@ -3,6 +3,11 @@
 #include <atomic>
 #include <chrono>
 #include <functional>
+#include <algorithm>
+
+#ifdef __linux__
+#include <fcntl.h>
+#endif
 
 #include "TServer.h"
 #include "main.h"
@@ -28,7 +33,7 @@ static const char* const filesystemTypes[] =
 extern std::atomic_bool shutdownProgram;
 
 TServer::TServer(const CString& pName)
-	: running(false), doRestart(false), name(pName), serverlist(this), wordFilter(this)
+	: running(false), doRestart(false), name(pName), serverlist(this), wordFilter(this), mapListVersion(1), translationVersion(1), clientSends(0)
 #ifdef V8NPCSERVER
 	, mScriptEngine(this), mPmHandlerNpc(nullptr)
 #endif
@@ -40,6 +45,13 @@ TServer::TServer(const CString& pName)
 	lastTimer = lastNWTimer = last1mTimer = last5mTimer = last3mTimer = time_now;
 	calculateServerTime();
 
+	// Wake up for the 50ms script timestep, or just often enough for the 1s timed events.
+#ifdef V8NPCSERVER
+	sockManager.setTickInterval(std::chrono::milliseconds(50));
+#else
+	sockManager.setTickInterval(std::chrono::milliseconds(100));
+#endif
+
 	// This has the full path to the server directory.
 	serverpath = CString() << getHomePath() << "servers/" << name << "/";
 	CFileSystem::fixPathSeparators(serverpath);
@@ -138,6 +150,13 @@ int TServer::init(const CString& serverip, const CString& serverport, const CStr
 		return ERR_LISTEN;
 	}
 
+#ifdef __linux__
+	// Non-blocking, so onRecv() can keep accepting until the backlog is empty.
+	int flags = fcntl(playerSock.getHandle(), F_GETFL, 0);
+	if (flags != -1)
+		fcntl(playerSock.getHandle(), F_SETFL, flags | O_NONBLOCK);
+#endif
+
 #ifdef UPNP
 	// Start a UPNP thread.  It will try to set a UPNP port forward in the background.
 	serverlog.out("[%s]      Starting UPnP discovery thread.\n", name.text());
@@ -300,15 +319,27 @@ void TServer::cleanup()
 	playerIds.clear();
 	playerList.clear();
 
+	for (auto& sock : acceptedSockets) {
+		delete sock;
+	}
+	acceptedSockets.clear();
+
+	// Nobody is left to send data to.
+	socketWorkers.stop();
+
 	for (auto& level : levelList) {
 		delete level;
 	}
 	levelList.clear();
+	levelIndex.clear();
+	missingLevels.clear();
 
 	for (auto& map : mapList) {
 		delete map;
 	}
 	mapList.clear();
+	levelMaps.clear();
+	++mapListVersion;
 
 	for (auto& npc : npcList) {
 		delete npc;
@@ -331,6 +362,10 @@ void TServer::cleanup()
 	playerSock.disconnect();
 	serverlist.getSocket()->disconnect();
 
+	// Stop watching the file systems.
+	sockManager.unregisterSocket(&fileWatcher);
+	fileWatcher.close();
+
 	// Clean up the socket manager.  Pass false so we don't cause a crash.
 	sockManager.cleanup(false);
 }
@@ -342,8 +377,21 @@ void TServer::restart()
 
 bool TServer::doMain()
 {
-	// Update our socket manager.
-	sockManager.update(0, 5000);		// 5ms
+	// Wait for socket activity or the next tick.  If scripts still have queued
+	// actions, only pick up what is already pending so they aren't delayed.
+	// Same if there are still connections waiting for a player.
+	int waitTime = (acceptedSockets.empty() ? -1 : 0);
+#ifdef V8NPCSERVER
+	if (mScriptEngine.hasPendingEvents())
+		waitTime = 0;
+#endif
+	sockManager.update(waitTime);
+
+	// Parse whatever the socket workers have decoded for us.
+	parseDecodedPlayers();
+
+	// Create players for the connections we accepted.
+	addAcceptedPlayers();
 
 	// Current time
 	auto currentTimer = std::chrono::high_resolution_clock::now();
@@ -382,24 +430,15 @@ bool TServer::doTimedEvents()
 	}
 
 	// Do level events.
+	// Levels register when their next event is due, so only those need to run.
 	{
-		for (auto level : levelList)
+		std::vector<TLevel *> dueLevels;
+		levelTimers.advance(getTimerSeconds(), dueLevels);
+		for (auto level : dueLevels)
 		{
-            assert(level);
+			assert(level);
 			level->doTimedEvents();
 		}
-
-		// Group levels.
-		for (auto & groupLevel : groupLevels)
-		{
-			for (auto & j : groupLevel.second)
-			{
-				TLevel* level = j.second;
-				assert(level);
-
-				level->doTimedEvents();
-			}
-		}
 	}
 
 	// Send NW time.
@@ -428,12 +467,17 @@ bool TServer::doTimedEvents()
 	{
 		last3mTimer = lastTimer;
 
-		// TODO(joey): probably a better way to do this..
+		// Resynchronize the file systems, unless the file watcher is keeping them up to date.
+		if (!fileWatcher.isActive())
+		{
+			filesystem_accounts.resync();
+			for (auto & i : filesystem)
+				i.resync();
+		}
 
-		// Resynchronize the file systems.
-		filesystem_accounts.resync();
-		for (auto & i : filesystem)
-			i.resync();
+		// The file watcher forgets missing levels as they are added.  Without it,
+		// or if it missed something, this catches them.
+		missingLevels.clear();
 	}
 
 	// Save stuff every 5 minutes.
@@ -492,48 +536,66 @@ bool TServer::doTimedEvents()
 
 bool TServer::onRecv()
 {
-	// Create socket.
-	CSocket *newSock = playerSock.accept();
-	if (newSock == nullptr)
-		return true;
+	// Only accept here.  The players are created in addAcceptedPlayers() after
+	// everyone else has had their turn.
+	// On Linux the listen socket is non-blocking, so take what is waiting up to
+	// the batch size.  Elsewhere accept() could block, so take just the one.
+#ifdef __linux__
+	const int batchSize = SERVER_ACCEPT_BATCH;
+#else
+	const int batchSize = 1;
+#endif
+	// The listen socket is level-triggered, so whatever we leave behind is
+	// reported again once addAcceptedPlayers() has made room.
+	for (int i = 0; i < batchSize && acceptedSockets.size() < SERVER_ACCEPT_WAITING; ++i)
+	{
+		CSocket *newSock = playerSock.accept();
+		if (newSock == nullptr)
+			break;
+
+		acceptedSockets.push_back(newSock);
+	}
 
-	// Create the new player.
-	auto *newPlayer = new TPlayer(this, newSock, 0);
+	return true;
+}
 
-	// Add the player to the server
-	if (!addPlayer(newPlayer))
+void TServer::addAcceptedPlayers()
+{
+	for (int i = 0; i < SERVER_ACCEPT_PLAYERS && !acceptedSockets.empty(); ++i)
 	{
-		delete newPlayer;
-		return false;
-	}
+		CSocket *newSock = acceptedSockets.front();
+		acceptedSockets.pop_front();
 
-	// Add them to the socket manager.
-	sockManager.registerSocket((CSocketStub*)newPlayer);
+		// Create the new player.
+		auto *newPlayer = new TPlayer(this, newSock, 0);
 
-	return true;
+		// Add the player to the server
+		if (!addPlayer(newPlayer))
+		{
+			delete newPlayer;
+			continue;
+		}
+
+		// Add them to the socket manager.
+		sockManager.registerSocket((CSocketStub*)newPlayer);
+	}
 }
 
 /////////////////////////////////////////////////////
 
-void TServer::loadAllFolders()
+void TServer::loadAllFolders(FolderList* pFolders)
 {
-	for (auto & fs : filesystem)
-		fs.clear();
-
-	filesystem[0].addDir("world");
+	pFolders[0].emplace_back("world", "*");
 	if (settings.getStr("sharefolder").length() > 0)
 	{
 		std::vector<CString> folders = settings.getStr("sharefolder").tokenize(",");
 		for (auto & folder : folders)
-			filesystem[0].addDir(folder.trim());
+			pFolders[0].emplace_back(folder.trim(), "*");
 	}
 }
 
-void TServer::loadFolderConfig()
+void TServer::loadFolderConfig(FolderList* pFolders)
 {
-	for (auto & i : filesystem)
-		i.clear();
-
 	foldersConfig = CString::loadToken(CString() << serverpath << "config/foldersconfig.txt", "\n", true);
 	for (auto & configLine : foldersConfig)
 	{
@@ -565,10 +627,10 @@ void TServer::loadFolderConfig()
 		// Add it to the appropriate file system.
 		if (fs != nullptr)
 		{
-			fs->addDir(dir, wildcard);
+			pFolders[fs - filesystem].emplace_back(dir, wildcard);
 			serverlog.out("[%s]        adding %s [%s] to %s\n", name.text(), dir.text(), wildcard.text(), type.text());
 		}
-		filesystem[0].addDir(dir, wildcard);
+		pFolders[0].emplace_back(dir, wildcard);
 	}
 }
 
@@ -578,10 +640,31 @@ int TServer::loadConfigFiles()
 	//	Move them out of here?
 	serverlog.out("[%s] :: Loading server configuration...\n", name.text());
 
+	// How long each step took, for the report at the end.
+	auto loadStart = std::chrono::steady_clock::now();
+	auto phaseStart = loadStart;
+	std::vector<std::pair<const char*, double> > phaseTimes;
+	auto endPhase = [&phaseStart, &phaseTimes](const char* phase)
+	{
+		auto now = std::chrono::steady_clock::now();
+		phaseTimes.emplace_back(phase, std::chrono::duration<double>(now - phaseStart).count());
+		phaseStart = now;
+	};
+
 	// Load Settings
 	serverlog.out("[%s]      Loading settings...\n", name.text());
 	loadSettings();
 
+	// Start the worker threads.  They compress and encrypt outgoing data, and
+	// help with loading until then.
+	if (!socketWorkers.isRunning())
+	{
+		unsigned int cores = std::thread::hardware_concurrency();
+		int sendThreads = settings.getInt("sendthreads", (cores > 1 ? (int)std::min(cores - 1, 8u) : 0));
+		if (sendThreads > 0)
+			socketWorkers.start((unsigned int)sendThreads);
+	}
+
 	// Load Admin Settings
 	serverlog.out("[%s]      Loading admin settings...\n", name.text());
 	loadAdminSettings();
@@ -589,6 +672,7 @@ int TServer::loadConfigFiles()
 	// Load allowed versions.
 	serverlog.out("[%s]      Loading allowed client versions...\n", name.text());
 	loadAllowedVersions();
+	endPhase("settings");
 
 	// Load folders config and file system.
 	serverlog.out("[%s]      Folder config: ", name.text());
@@ -598,6 +682,7 @@ int TServer::loadConfigFiles()
 	} else serverlog.append("disabled\n");
 	serverlog.out("[%s]      Loading file system...\n", name.text());
 	loadFileSystem();
+	endPhase("file system");
 
 	// Load server flags.
 	serverlog.out("[%s]      Loading serverflags.txt...\n", name.text());
@@ -610,23 +695,28 @@ int TServer::loadConfigFiles()
 	// Load IP bans.
 	serverlog.out("[%s]      Loading config/ipbans.txt...\n", name.text());
 	loadIPBans();
+	endPhase("server flags");
 
 	// Load weapons.
 	serverlog.out("[%s]      Loading weapons...\n", name.text());
 	loadWeapons(true);
+	endPhase("weapons");
 
 	// Load classes.
 	serverlog.out("[%s]      Loading classes...\n", name.text());
 	loadClasses(true);
+	endPhase("classes");
 
 	// Load maps.
 	serverlog.out("[%s]      Loading maps...\n", name.text());
 	loadMaps(true);
+	endPhase("maps");
 
 #ifdef V8NPCSERVER
 	// Load database npcs.
 	serverlog.out("[%s]      Loading npcs...\n", name.text());
 	loadNpcs(true);
+	endPhase("npcs");
 #endif
 
 	// Load translations.
@@ -636,6 +726,21 @@ int TServer::loadConfigFiles()
 	// Load word filter.
 	serverlog.out("[%s]      Loading word filter...\n", name.text());
 	loadWordFilter();
+	endPhase("translations");
+
+	// Load the levels on the maps now instead of when the first player walks in.
+	if (settings.getBool("preloadlevels", false))
+	{
+		serverlog.out("[%s]      Preloading levels...\n", name.text());
+		preloadLevels(true);
+		endPhase("levels");
+	}
+
+	// Report where the time went.
+	double total = std::chrono::duration<double>(std::chrono::steady_clock::now() - loadStart).count();
+	serverlog.out("[%s] :: Loaded server configuration in %.3fs\n", name.text(), total);
+	for (auto & phase : phaseTimes)
+		serverlog.out("[%s]        %-14s %.3fs\n", name.text(), phase.first, phase.second);
 
 	return 0;
 }
@@ -701,14 +806,54 @@ void TServer::loadAllowedVersions()
 
 void TServer::loadFileSystem()
 {
-	for (auto & i : filesystem)
-		i.clear();
-	filesystem_accounts.clear();
-	filesystem_accounts.addDir("accounts");
+	// Work out what goes in each file system first, then scan them all at once.
+	FolderList folders[FS_COUNT];
 	if ( settings.getBool("nofoldersconfig", false))
-		loadAllFolders();
+		loadAllFolders(folders);
 	else
-		loadFolderConfig();
+		loadFolderConfig(folders);
+
+	// This also runs while players are on (/reloadserver, /refreshfilesystem).
+	// Each file system is cleared and reloaded in one update, so lookups keep
+	// finding the old files until the new list replaces them.
+	std::vector<std::function<void()> > jobs;
+	jobs.emplace_back([this]()
+	{
+		filesystem_accounts.beginUpdate();
+		filesystem_accounts.clear();
+		filesystem_accounts.addDir("accounts");
+		filesystem_accounts.endUpdate();
+	});
+	for (int i = 0; i < FS_COUNT; ++i)
+	{
+		jobs.emplace_back([this, i, &folders]()
+		{
+			filesystem[i].beginUpdate();
+			filesystem[i].clear();
+			for (auto & folder : folders[i])
+				filesystem[i].addDir(folder.first, folder.second);
+			filesystem[i].endUpdate();
+		});
+	}
+	socketWorkers.runAll(jobs);
+
+	watchFileSystems();
+}
+
+void TServer::watchFileSystems()
+{
+	// Without a watcher, doTimedEvents() resyncs the file systems instead.
+	bool wasActive = fileWatcher.isActive();
+	if (!fileWatcher.open())
+		return;
+
+	fileWatcher.clear();
+	fileWatcher.watch(&filesystem_accounts);
+	for (auto & fs : filesystem)
+		fileWatcher.watch(&fs);
+
+	if (!wasActive)
+		sockManager.registerSocket(&fileWatcher);
 }
 
 void TServer::loadServerFlags()
@@ -734,15 +879,27 @@ void TServer::loadClasses(bool print)
 {
 	CFileSystem scriptFS(this);
 	scriptFS.addDir("scripts", "*.txt");
-	const std::map<CString, CString> &scriptFileList = scriptFS.getFileList();
-	for (auto & scriptFile : scriptFileList)
-	{
-		std::string className = scriptFile.first.subString(0, scriptFile.first.length() - 4).text();
+	auto scriptFileList = scriptFS.getFileList();
 
-		CString scriptData;
-		scriptData.load(scriptFile.second);
-		classList[className] = std::make_unique<TScriptClass>(this, className, scriptData.text());
+	// Read and parse the scripts on the workers, then add them in order.
+	std::vector<std::pair<std::string, std::unique_ptr<TScriptClass> > > classes;
+	std::vector<std::function<void()> > jobs;
+	classes.reserve(scriptFileList->size());
+	for (auto & scriptFile : *scriptFileList)
+	{
+		size_t index = classes.size();
+		classes.emplace_back(scriptFile.first.subString(0, scriptFile.first.length() - 4).text(), nullptr);
+		jobs.emplace_back([this, index, &classes, &scriptFile]()
+		{
+			CString scriptData;
+			scriptData.load(scriptFile.second);
+			classes[index].second = std::make_unique<TScriptClass>(this, classes[index].first, scriptData.text());
+		});
 	}
+	socketWorkers.runAll(jobs);
+
+	for (auto & scriptClass : classes)
+		classList[scriptClass.first] = std::move(scriptClass.second);
 }
 
 void TServer::loadWeapons(bool print)
@@ -751,13 +908,30 @@ void TServer::loadWeapons(bool print)
 	weaponFS.addDir("weapons", "weapon*.txt");
 	CFileSystem bcweaponFS(this);
 	bcweaponFS.addDir("weapon_bytecode", "*");
-	const std::map<CString, CString> &weaponFileList = weaponFS.getFileList();
-	for (auto & weaponFile : weaponFileList)
+	auto weaponFileList = weaponFS.getFileList();
+
+	// Read the files on the workers.  Creating the weapons compiles their
+	// scripts, so that stays on this thread.
+	std::vector<std::pair<const CString*, SWeaponFile> > weaponFiles(weaponFileList->size());
+	std::vector<std::function<void()> > jobs;
+	size_t index = 0;
+	for (auto & weaponFile : *weaponFileList)
 	{
-		TWeapon *weapon = TWeapon::loadWeapon(weaponFile.first, this);
-		if (weapon == nullptr) continue;
+		auto file = &weaponFiles[index++];
+		jobs.emplace_back([this, file, &weaponFile]()
+		{
+			if (TWeapon::readWeapon(weaponFile.first, this, file->second))
+				file->first = &weaponFile.first;
+		});
+	}
+	socketWorkers.runAll(jobs);
+
+	for (auto & weaponFile : weaponFiles)
+	{
+		if (weaponFile.first == nullptr) continue;
+		TWeapon *weapon = TWeapon::createWeapon(weaponFile.second, this);
 		if (!weapon->hasBytecode())
-			weapon->setModTime(weaponFS.getModTime(weaponFile.first));
+			weapon->setModTime(weaponFS.getModTime(*weaponFile.first));
 		else
 			weapon->setModTime(bcweaponFS.getModTime(weapon->getByteCodeFile()));
 
@@ -816,6 +990,7 @@ void TServer::loadMaps(bool print)
 		delete map;
 		i = mapList.erase(i);
 	}
+	levelMaps.clear();
 
 	// Load gmaps.
 	std::vector<CString> gmaps = settings.getStr("gmaps").guntokenize().tokenize("\n");
@@ -892,6 +1067,16 @@ void TServer::loadMaps(bool print)
 		if (print) serverlog.out("[%s]        [group map] %s\n", name.text(), groupmap.text());
 		mapList.push_back(gmap);
 	}
+
+	// Index which map each level is on.  If a level is on several maps, the first one wins.
+	for (auto map : mapList)
+	{
+		for (auto& level : map->getMapLevels())
+			levelMaps.emplace(level.first, map);
+	}
+
+	// Levels re-fetch their cached map when this changes.
+	++mapListVersion;
 }
 
 #ifdef V8NPCSERVER
@@ -899,14 +1084,27 @@ void TServer::loadNpcs(bool print)
 {
 	CFileSystem npcFS(this);
 	npcFS.addDir("npcs", "npc*.txt");
-	const std::map<CString, CString> &npcFileList = npcFS.getFileList();
-	for (auto it = npcFileList.begin(); it != npcFileList.end(); ++it)
+	auto npcFileList = npcFS.getFileList();
+
+	// Read the files on the workers, then create the npcs here.
+	std::vector<CString> npcFiles(npcFileList->size());
+	std::vector<std::function<void()> > jobs;
+	size_t index = 0;
+	for (auto & npcFile : *npcFileList)
 	{
+		CString* fileData = &npcFiles[index++];
+		jobs.emplace_back([fileData, &npcFile]() { fileData->load(npcFile.second); });
+	}
+	socketWorkers.runAll(jobs);
+
+	for (auto & fileData : npcFiles)
+	{
+		if (fileData.isEmpty()) continue;
 		bool loaded = false;
 
 		// Create the npc
 		TNPC *newNPC = new TNPC("", "", 30, 30.5, this, nullptr, false);
-		if (newNPC->loadNPC((*it).second))
+		if (newNPC->loadNPCData(fileData))
 		{
 			int npcId = newNPC->getId();
 			if (npcId < 1000)
@@ -942,6 +1140,41 @@ void TServer::loadNpcs(bool print)
 }
 #endif
 
+void TServer::preloadLevels(bool print)
+{
+	// Every level on a map, and every level those link to.
+	std::deque<CString> pending;
+	std::unordered_set<std::string> seen;
+	for (auto map : mapList)
+	{
+		for (auto & level : map->getMapLevels())
+		{
+			if (seen.insert(CString(level.first.c_str()).toLower().text()).second)
+				pending.emplace_back(level.first.c_str());
+		}
+	}
+
+	// Loading a level creates its npcs, so this has to happen on this thread.
+	int count = 0;
+	while (!pending.empty())
+	{
+		TLevel* level = TLevel::findLevel(pending.front(), this);
+		pending.pop_front();
+		if (level == nullptr) continue;
+		++count;
+
+		for (auto & link : level->getLevelLinks())
+		{
+			CString newLevel = link.getNewLevel();
+			if (newLevel.isEmpty()) continue;
+			if (seen.insert(newLevel.toLower().text()).second)
+				pending.push_back(newLevel);
+		}
+	}
+
+	if (print) serverlog.out("[%s]        %d levels\n", name.text(), count);
+}
+
 void TServer::loadTranslations()
 {
 	this->TS_Reload();
@@ -964,7 +1197,7 @@ void TServer::saveWeapons()
 {
 	CFileSystem weaponFS(this);
 	weaponFS.addDir("weapons", "weapon*.txt");
-	const std::map<CString, CString>& weaponFileList = weaponFS.getFileList();
+	auto weaponFileList = weaponFS.getFileList();
 
 	for (auto & weapon : weaponList)
 	{
@@ -1173,11 +1406,9 @@ TMap* TServer::getMap(const TLevel* pLevel) const
 {
 	if (pLevel == 0) return 0;
 
-	for (auto pMap : mapList)
-	{
-			if (pMap->isLevelOnMap(pLevel->getLevelName()))
-			return pMap;
-	}
+	auto it = levelMaps.find(pLevel->getLevelName().text());
+	if (it != levelMaps.end())
+		return it->second;
 	return nullptr;
 }
 
@@ -1495,6 +1726,47 @@ bool TServer::addPlayer(TPlayer *player, unsigned int id)
 	return true;
 }
 
+void TServer::addDecodedPlayer(TPlayer* player)
+{
+	// Called from the socket workers.
+	{
+		std::lock_guard<std::mutex> lock(decodedLock);
+		decodedPlayers.push_back(player);
+	}
+	sockManager.wakeup();
+}
+
+void TServer::removeDecodedPlayer(TPlayer* player)
+{
+	std::lock_guard<std::mutex> lock(decodedLock);
+	decodedPlayers.erase(std::remove(decodedPlayers.begin(), decodedPlayers.end(), player), decodedPlayers.end());
+}
+
+void TServer::parseDecodedPlayers()
+{
+	std::vector<TPlayer *> players;
+	{
+		std::lock_guard<std::mutex> lock(decodedLock);
+		if (decodedPlayers.empty())
+			return;
+		players.swap(decodedPlayers);
+	}
+
+	// A player can be in here more than once, the first call parses everything.
+	std::set<TPlayer *> parsed;
+	for (auto player : players)
+	{
+		if (!parsed.insert(player).second || deletedPlayers.find(player) != deletedPlayers.end())
+			continue;
+
+		if (!player->parseDecoded())
+		{
+			sockManager.unregisterSocket(player);
+			deletePlayer(player);
+		}
+	}
+}
+
 bool TServer::deletePlayer(TPlayer* player)
 {
 	if (player == nullptr)
@@ -1624,123 +1896,137 @@ bool TServer::setFlag(const std::string& pFlagName, const CString& pFlagValue, b
 /*
 	Packet-Sending Functions
 */
-void TServer::sendPacketToAll(CString pPacket, TPlayer *pPlayer) const
+// Newline terminate a broadcast packet once, so recipients can queue it as-is.
+static CString terminatePacket(const CString& pPacket)
 {
+	CString packet(pPacket);
+	if (!packet.isEmpty() && packet[packet.length()-1] != '\n')
+		packet.writeChar('\n');
+	return packet;
+}
+
+void TServer::sendPacketToAll(const CString& pPacket, TPlayer *pPlayer) const
+{
+	CString packet = terminatePacket(pPacket);
 	for (auto player : playerList)
 	{
 		if ( player == pPlayer || player->isNPCServer()) continue;
 
-		player->sendPacket(pPacket);
+		player->sendPacket(packet, false);
 	}
 }
 
-void TServer::sendPacketToLevel(CString pPacket, TMap* pMap, TLevel* pLevel, TPlayer* pPlayer, bool onlyGmap) const
+void TServer::sendPacketToLevel(const CString& pPacket, TMap* pMap, TLevel* pLevel, TPlayer* pPlayer, bool onlyGmap) const
 {
+	CString packet = terminatePacket(pPacket);
+
 	if (pMap == nullptr || (onlyGmap && pMap->getType() == MAPTYPE_BIGMAP))// || pLevel->isGroupLevel())
 	{
-		for (auto p : playerList)
+		if (pLevel == nullptr) return;
+		for (auto p : *pLevel->getPlayerList())
 		{
 			if ( p == pPlayer || !p->isClient()) continue;
-			if ( p->getLevel() == pLevel)
-				p->sendPacket(pPacket);
+			p->sendPacket(packet, false);
 		}
 		return;
 	}
 
 	if (pLevel == 0) return;
 	bool _groupMap = (pPlayer == 0 ? false : pPlayer->getMap()->isGroupMap());
-	for (auto other : playerList)
-	{
-			if (!other->isClient() || other == pPlayer || other->getLevel() == 0) continue;
-		if (_groupMap && pPlayer != 0 && pPlayer->getGroup() != other->getGroup()) continue;
 
-		if (other->getMap() == pMap)
+	// Only players in the 3x3 block of map cells around the level can see it.
+	int sgmap[2] = {pLevel->getMapX(), pLevel->getMapY()};
+	if (pLevel->getMap() != pMap)
+	{
+		sgmap[0] = pMap->getLevelX(pLevel->getActualLevelName());
+		sgmap[1] = pMap->getLevelY(pLevel->getActualLevelName());
+	}
+	for (int cy = sgmap[1] - 1; cy <= sgmap[1] + 1; ++cy)
+	{
+		for (int cx = sgmap[0] - 1; cx <= sgmap[0] + 1; ++cx)
 		{
-			int sgmap[2] = {pMap->getLevelX(pLevel->getActualLevelName()), pMap->getLevelY(pLevel->getActualLevelName())};
-			int ogmap[2];
-			switch (pMap->getType())
+			const std::vector<TPlayer*>* cell = pMap->getPlayersAt(cx, cy);
+			if (cell == nullptr) continue;
+
+			for (auto other : *cell)
 			{
-				case MAPTYPE_GMAP:
-					ogmap[0] = other->getProp(PLPROP_GMAPLEVELX).readGUChar();
-					ogmap[1] = other->getProp(PLPROP_GMAPLEVELY).readGUChar();
-					break;
-
-				default:
-				case MAPTYPE_BIGMAP:
-					ogmap[0] = pMap->getLevelX(other->getLevel()->getActualLevelName());
-					ogmap[1] = pMap->getLevelY(other->getLevel()->getActualLevelName());
-					break;
-			}
+				if (!other->isClient() || other == pPlayer || other->getLevel() == 0) continue;
+				if (_groupMap && pPlayer != 0 && pPlayer->getGroup() != other->getGroup()) continue;
+				if (other->getMap() != pMap) continue;
 
-			if (abs(ogmap[0] - sgmap[0]) < 2 && abs(ogmap[1] - sgmap[1]) < 2)
-				other->sendPacket(pPacket);
+				other->sendPacket(packet, false);
+			}
 		}
 	}
 }
 
-void TServer::sendPacketToLevel(CString pPacket, TMap* pMap, TPlayer* pPlayer, bool sendToSelf, bool onlyGmap) const
+void TServer::sendPacketToLevel(const CString& pPacket, TMap* pMap, TPlayer* pPlayer, bool sendToSelf, bool onlyGmap) const
 {
 	if (pPlayer->getLevel() == nullptr) return;
+	CString packet = terminatePacket(pPacket);
 
 	if (pMap == nullptr || (onlyGmap && pMap->getType() == MAPTYPE_BIGMAP) || pPlayer->getLevel()->isSingleplayer())
 	{
 		TLevel* level = pPlayer->getLevel();
 		if (level == nullptr) return;
-		for (auto p : playerList)
+		for (auto p : *level->getPlayerList())
 		{
 			if ((p == pPlayer && !sendToSelf) || !p->isClient()) continue;
-			if ( p->getLevel() == level)
-				p->sendPacket(pPacket);
+			p->sendPacket(packet, false);
 		}
 		return;
 	}
 
+	if (sendToSelf && pPlayer->isClient())
+		pPlayer->sendPacket(packet, false);
+
+	// Only players in the 3x3 block of map cells around us can see us.
 	bool _groupMap = pPlayer->getMap()->isGroupMap();
-	for (auto player : playerList)
+	int sgmap[2];
+	if (pMap->getType() == MAPTYPE_GMAP)
 	{
-		if (!player->isClient()) continue;
-		if ( player == pPlayer)
-		{
-			if (sendToSelf) pPlayer->sendPacket(pPacket);
-			continue;
-		}
-		if ( player->getLevel() == nullptr) continue;
-		if (_groupMap && pPlayer->getGroup() != player->getGroup()) continue;
+		sgmap[0] = pPlayer->getProp(PLPROP_GMAPLEVELX).readGUChar();
+		sgmap[1] = pPlayer->getProp(PLPROP_GMAPLEVELY).readGUChar();
+	}
+	else if (pPlayer->getLevel()->getMap() == pMap)
+	{
+		sgmap[0] = pPlayer->getLevel()->getMapX();
+		sgmap[1] = pPlayer->getLevel()->getMapY();
+	}
+	else
+	{
+		sgmap[0] = pMap->getLevelX(pPlayer->getLevel()->getActualLevelName());
+		sgmap[1] = pMap->getLevelY(pPlayer->getLevel()->getActualLevelName());
+	}
 
-		if ( player->getMap() == pMap)
+	for (int cy = sgmap[1] - 1; cy <= sgmap[1] + 1; ++cy)
+	{
+		for (int cx = sgmap[0] - 1; cx <= sgmap[0] + 1; ++cx)
 		{
-			int ogmap[2], sgmap[2];
-			switch (pMap->getType())
+			const std::vector<TPlayer*>* cell = pMap->getPlayersAt(cx, cy);
+			if (cell == nullptr) continue;
+
+			for (auto player : *cell)
 			{
-				case MAPTYPE_GMAP:
-					ogmap[0] = player->getProp(PLPROP_GMAPLEVELX).readGUChar();
-					ogmap[1] = player->getProp(PLPROP_GMAPLEVELY).readGUChar();
-					sgmap[0] = pPlayer->getProp(PLPROP_GMAPLEVELX).readGUChar();
-					sgmap[1] = pPlayer->getProp(PLPROP_GMAPLEVELY).readGUChar();
-					break;
-
-				default:
-				case MAPTYPE_BIGMAP:
-					ogmap[0] = pMap->getLevelX(player->getLevel()->getActualLevelName());
-					ogmap[1] = pMap->getLevelY(player->getLevel()->getActualLevelName());
-					sgmap[0] = pMap->getLevelX(pPlayer->getLevel()->getActualLevelName());
-					sgmap[1] = pMap->getLevelY(pPlayer->getLevel()->getActualLevelName());
-					break;
-			}
+				if (!player->isClient() || player == pPlayer) continue;
+				if ( player->getLevel() == nullptr) continue;
+				if (_groupMap && pPlayer->getGroup() != player->getGroup()) continue;
+				if ( player->getMap() != pMap) continue;
 
-			if (abs(ogmap[0] - sgmap[0]) < 2 && abs(ogmap[1] - sgmap[1]) < 2)
-				player->sendPacket(pPacket);
+				player->sendPacket(packet, false);
+			}
 		}
 	}
 }
 
-void TServer::sendPacketTo(int who, CString pPacket, TPlayer* pPlayer) const
+void TServer::sendPacketTo(int who, const CString& pPacket, TPlayer* pPlayer) const
 {
+	CString packet = terminatePacket(pPacket);
 	for (auto player : playerList)
 	{
 		if ( player == pPlayer) continue;
 		if ( player->getType() & who)
-			player->sendPacket(pPacket);
+			player->sendPacket(packet, false);
 	}
 }
 
@@ -1809,6 +2095,9 @@ bool TServer::TS_Load(const CString& pLanguage, const CString& pFileName)
 	if (fileData.empty())
 		return false;
 
+	// Translated text we handed out may change.
+	++translationVersion;
+
 	// Parse File
 	std::vector<CString>::const_iterator cur, next;
 	for (cur = fileData.begin(); cur != fileData.end(); ++cur)
@@ -1867,14 +2156,15 @@ void TServer::TS_Reload()
 
 	// Reset Translations
 	mTranslationManager.reset();
+	++translationVersion;
 
 	// Load Translation Folder
 	CFileSystem translationFS(this);
 	translationFS.addDir("translations", "*.po");
 
 	// Load Each File
-	const std::map<CString, CString> &temp = translationFS.getFileList();
-	for (auto & i : temp)
+	auto temp = translationFS.getFileList();
+	for (auto & i : *temp)
 		this->TS_Load(removeExtension(i.first), i.second);
 }
 
@@ -119,27 +119,35 @@ bool TServerList::main()
 	CString unBuffer;
 
 	// parse data
-	rBuffer.setRead(0);
-	while (rBuffer.length() > 1)
+	unsigned int readPos = 0;
+	while ((unsigned int)rBuffer.length() - readPos > 1)
 	{
 		// New data.
 		lastData = time(0);
 
 		// packet length
+		rBuffer.setRead(readPos);
 		unsigned short len = (unsigned short)rBuffer.readShort();
-		if ((unsigned int)len > (unsigned int)rBuffer.length() - 2)
+		if ((unsigned int)len > (unsigned int)rBuffer.length() - readPos - 2)
 			break;
 
 		// decompress packet
 		unBuffer = rBuffer.readChars(len);
-		rBuffer.removeI(0, len + 2);
+		readPos += len + 2;
 		unBuffer.zuncompressI();
 
 		// well theres your buffer
 		if (!parsePacket(unBuffer))
+		{
+			rBuffer.removeI(0, readPos);
 			return false;
+		}
 	}
 
+	// Remove the processed packets.
+	if (readPos > 0)
+		rBuffer.removeI(0, readPos);
+
 	_server->getSocketManager()->updateSingle(this, false, true);
 
 	return getConnected();
@@ -296,6 +304,7 @@ void TServerList::sendPacket(CString& pPacket, bool sendNow)
 
 	// append buffer
 	_fileQueue.addPacket(pPacket);
+	_server->getSocketManager()->markDirty(this);
 
 	// send buffer now?
 	if (sendNow)
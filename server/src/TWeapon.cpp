@@ -41,6 +41,16 @@ TWeapon::~TWeapon()
 
 // -- Function: Load Weapon -- //
 TWeapon * TWeapon::loadWeapon(const CString& pWeapon, TServer *server)
+{
+	SWeaponFile file;
+	if (!readWeapon(pWeapon, server, file))
+		return nullptr;
+
+	return createWeapon(file, server);
+}
+
+// -- Function: Read Weapon -- //
+bool TWeapon::readWeapon(const CString& pWeapon, TServer *server, SWeaponFile& pFile)
 {
 	// File Path
 	CString fileName = server->getServerPath() << "weapons" << CFileSystem::getPathSeparator() << pWeapon;
@@ -48,7 +58,7 @@ TWeapon * TWeapon::loadWeapon(const CString& pWeapon, TServer *server)
 	// Load File
 	CString fileData;
 	if (!fileData.load(fileName))
-		return nullptr;
+		return false;
 
 	fileData.removeAllI("\r");
 
@@ -60,11 +70,7 @@ TWeapon * TWeapon::loadWeapon(const CString& pWeapon, TServer *server)
 	// Parse header
 	CString headerLine = fileData.readString("\n");
 	if (headerLine != "GRAWP001")
-		return nullptr;
-
-	// Definitions
-	CString weaponImage, weaponName, weaponScript, byteCodeFile;
-	std::vector<std::pair<CString, CString> > byteCode;
+		return false;
 
 	// Parse File
 	while (fileData.bytesLeft())
@@ -76,9 +82,9 @@ TWeapon * TWeapon::loadWeapon(const CString& pWeapon, TServer *server)
 
 		// Parse Line
 		if (curCommand == "REALNAME")
-			weaponName = curLine.readString("");
+			pFile.name = curLine.readString("");
 		else if (curCommand == "IMAGE")
-			weaponImage = curLine.readString("");
+			pFile.image = curLine.readString("");
 		else if (curCommand == "BYTECODE")
 		{
 			CString fname = curLine.readString("");
@@ -86,8 +92,8 @@ TWeapon * TWeapon::loadWeapon(const CString& pWeapon, TServer *server)
 			bytecode.load(server->getServerPath() << "weapon_bytecode/" << fname);
 
 			if (!bytecode.isEmpty()) {
-				byteCode.emplace_back(fname, bytecode);
-				byteCodeFile = fname;
+				pFile.byteCode.emplace_back(fname, bytecode);
+				pFile.byteCodeFile = fname;
 			}
 		}
 		else if (curCommand == "SCRIPT")
@@ -100,32 +106,39 @@ TWeapon * TWeapon::loadWeapon(const CString& pWeapon, TServer *server)
 					break;
 				}
 
-				weaponScript << curLine << "\n";
+				pFile.script << curLine << "\n";
 			} while (fileData.bytesLeft());
 		}
 	}
 
 	// Valid Weapon Name?
-	if (weaponName.isEmpty())
-		return nullptr;
+	if (pFile.name.isEmpty())
+		return false;
 
+	pFile.malformed = (has_scriptend && !found_scriptend);
+	return true;
+}
+
+// -- Function: Create Weapon -- //
+TWeapon * TWeapon::createWeapon(const SWeaponFile& pFile, TServer *server)
+{
 	// Give a warning if our weapon was malformed.
-	if (has_scriptend && !found_scriptend)
+	if (pFile.malformed)
 	{
-		server->getServerLog().out("[%s] WARNING: Weapon %s is malformed.\n", server->getName().text(), weaponName.text());
+		server->getServerLog().out("[%s] WARNING: Weapon %s is malformed.\n", server->getName().text(), pFile.name.text());
 		server->getServerLog().out("[%s] SCRIPTEND needs to be on its own line.\n", server->getName().text());
 	}
 
 	// Give a warning if both a script and a bytecode was found.
-	if (!weaponScript.isEmpty() && !byteCode.empty())
-		server->getServerLog().out("[%s] WARNING: Weapon %s includes both script and bytecode.  Using bytecode.\n", server->getName().text(), weaponName.text());
+	if (!pFile.script.isEmpty() && !pFile.byteCode.empty())
+		server->getServerLog().out("[%s] WARNING: Weapon %s includes both script and bytecode.  Using bytecode.\n", server->getName().text(), pFile.name.text());
 
-	TWeapon* ret = new TWeapon(server, weaponName, weaponImage, weaponScript, 0);
-	if (!byteCode.empty())
-		ret->mByteCode = byteCode;
+	TWeapon* ret = new TWeapon(server, pFile.name, pFile.image, pFile.script, 0);
+	if (!pFile.byteCode.empty())
+		ret->mByteCode = pFile.byteCode;
 
-	if (!byteCodeFile.isEmpty())
-		ret->mByteCodeFile = byteCodeFile;
+	if (!pFile.byteCodeFile.isEmpty())
+		ret->mByteCodeFile = pFile.byteCodeFile;
 
 	return ret;
 }
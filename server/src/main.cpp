@@ -13,6 +13,7 @@
 #include "CLog.h"
 #include "CSocket.h"
 #include "TServer.h"
+#include "CFileCache.h"
 #include <TAccount.h>
 
 // Linux specific stuff.
@@ -91,6 +92,9 @@ int main(int argc, char* argv[])
 				return ERR_SETTINGS;
 			}
 
+			// The file cache is shared by every server.
+			CFileCache::shared().setByteLimit((size_t)serversettings.getInt("filecachesize", FILECACHE_DEFAULTSIZE / (1024 * 1024)) * 1024 * 1024);
+
 			// Load servers.
 			for (int i = 1; i <= serversettings.getInt("servercount"); ++i)
 			{